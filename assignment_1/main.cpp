@@ -1,94 +1,270 @@
+#include <assignmentconfig.h>
+
+#include <argparse/argparse.hpp>
+#include <histogram.hpp>
+#include <threadpool.hpp>
+#include <unbounded_queue.hpp>
+
+#include <atomic>
+#include <barrier>
+#include <chrono>
 #include <cstdio>
-#include <thread>
 #include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
-#include <memory> 
-#include <chrono>
-#include <numeric>
-#include <functional>
-
-/* Define a new type for unary functions which get an In type template and an Out type template */
-template <typename Out, typename In>
-using fun_unary = std::function<Out(In)>;
 
 /***
- * Evaluate overhead needed to start/join a thread and to start an async (launch::async policy) and get the result of the computed future. 
- * Measures should be taken as averages of a large number of events. 
- * Possibly, measure times on your machine AND on the remote virtual machine
+ * Latency distribution of the threading primitives our runtime is built on:
+ * thread start/join, std::async, spm::threadpool submit, unbounded_queue
+ * hand-off, barrier round trip and spm::future wake-up. Each sample is
+ * measured in nanoseconds and recorded in a histogram, so the tail (p99,
+ * p99.9) is reported and not only the average.
  */
 
-void inline print_statistics(std::vector<long long>& stats, const std::size_t iters, const char* message) {
+using results = std::vector<std::pair<std::string, spm::histogram>>;
+
+/// Untimed samples of each benchmark (first touch, thread creation, ...)
+constexpr std::size_t WARMUP = 1000;
+
+/// Monotonic time in nanoseconds, comparable between threads.
+inline std::int64_t now_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline void record(spm::histogram& h, std::int64_t start, std::int64_t stop) noexcept {
+    h.record(stop > start ? static_cast<std::uint64_t>(stop - start) : 0);
+}
+
+/// Start a thread running an empty function and join it.
+spm::histogram bench_thread(std::size_t samples) {
+    spm::histogram h;
+
+    for (std::size_t i = 0; i < samples + WARMUP; i++) {
+        auto start = now_ns();
+        std::thread([]() {}).join();
+        if (i >= WARMUP) record(h, start, now_ns());
+    }
+
+    return h;
+}
+
+/// Launch an async (launch::async policy) and get its result.
+spm::histogram bench_async(std::size_t samples) {
+    spm::histogram h;
 
-    double avg = std::accumulate(stats.begin(), stats.end(), 0LL, std::plus<long long>()) / static_cast<double>(stats.size());
-    std::fprintf(stdout, "%s: %ld iterations, average %.2f museconds\n", message, iters, avg);
+    for (std::size_t i = 0; i < samples + WARMUP; i++) {
+        auto start = now_ns();
+        std::async(std::launch::async, []() { return 0; }).get();
+        if (i >= WARMUP) record(h, start, now_ns());
+    }
 
-    return;
+    return h;
 }
 
-template <typename Out, typename In>
-void run_thread_suite(const std::size_t iters, const fun_unary<Out, In> &fun, In arg) {
+/// Submit a task to an idle pool: time until a worker runs it, and until
+/// the submitter gets its result.
+std::pair<spm::histogram, spm::histogram> bench_threadpool(std::size_t samples, unsigned nw) {
+    spm::histogram to_run, to_get;
+    spm::threadpool pool(nw);
+
+    for (std::size_t i = 0; i < samples + WARMUP; i++) {
+        auto start = now_ns();
+        auto future = pool.submit([]() { return now_ns(); });
+        auto run = future->get();
+        auto stop = now_ns();
 
-    std::vector<long long> results; 
+        if (i >= WARMUP) {
+            record(to_run, start, run);
+            record(to_get, start, stop);
+        }
+    }
 
-    for (std::size_t i = 0; i < iters; i++) {
+    pool.shutdown();
+    return {std::move(to_run), std::move(to_get)};
+}
 
-        /* Start the timer. */
-        auto start = std::chrono::system_clock::now();
+/// Round trip of a message through two queues and an echo thread.
+spm::histogram bench_queue(std::size_t samples) {
+    spm::histogram h;
+    spm::unbounded_queue<std::int64_t> ping, pong;
 
-        /* Start a new thread */
-        auto tid = std::thread(fun, arg);
-        /* Join for the new thread */
-        tid.join();
+    std::thread echo([&]() {
+        // A negative message ends the stream
+        for (auto msg = ping.dequeue();; msg = ping.dequeue()) {
+            pong.enqueue(msg);
+            if (msg < 0) break;
+        }
+    });
 
-        /* End the timer. */
-        auto elapsed = std::chrono::system_clock::now() - start;
-        auto musec = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
-        /* Put the elapsed time into the measure array. */
-        results.push_back(musec);
+    for (std::size_t i = 0; i < samples + WARMUP; i++) {
+        auto start = now_ns();
+        ping.enqueue(start);
+        pong.dequeue();
+        if (i >= WARMUP) record(h, start, now_ns());
     }
 
-    print_statistics(results, iters, "Overhead to start/join thread");
+    ping.enqueue(-1);
+    pong.dequeue();
+    echo.join();
 
-    return;
+    return h;
 }
 
-template <typename Out, typename In>
-void run_async_suite(const std::size_t iters, const fun_unary<Out, In> &fun, In arg) {
+/// Time spent by a thread in a barrier shared with parties - 1 other ones,
+/// all of them looping over it.
+spm::histogram bench_barrier(std::size_t samples, unsigned parties) {
+    spm::histogram h;
+    std::barrier sync_point(parties);
+
+    std::vector<std::thread> others;
+    for (unsigned t = 1; t < parties; t++) {
+        others.emplace_back([&]() {
+            for (std::size_t i = 0; i < samples + WARMUP; i++) sync_point.arrive_and_wait();
+        });
+    }
+
+    for (std::size_t i = 0; i < samples + WARMUP; i++) {
+        auto start = now_ns();
+        sync_point.arrive_and_wait();
+        if (i >= WARMUP) record(h, start, now_ns());
+    }
+
+    for (auto& t : others) t.join();
+    return h;
+}
 
-    std::vector<long long> results;
+/// Time from put() to the return of get() in a thread blocked on the future.
+spm::histogram bench_future(std::size_t samples, std::chrono::microseconds gap) {
+    using future = spm::future<std::int64_t>;
 
-    for (std::size_t i = 0; i < iters; i++) {
+    spm::histogram h;
+    std::atomic<future*> slot{nullptr};
 
-        /* Start the timer. */
-        auto start = std::chrono::system_clock::now();
+    std::thread waiter([&]() {
+        for (std::size_t i = 0; i < samples + WARMUP; i++) {
+            future* f;
+            while ((f = slot.exchange(nullptr, std::memory_order_acquire)) == nullptr)
+                std::this_thread::yield();
 
-        /* Start an async */
-        auto future = std::async(std::launch::async, fun, arg);
-        /* Wait for its completition and discard the returned value */
-        future.get();
+            std::unique_ptr<future> owned(f);
+            auto put_time = owned->get();
+            if (i >= WARMUP) record(h, put_time, now_ns());
+        }
+    });
 
-        /* End the timer. */
-        auto elapsed = std::chrono::system_clock::now() - start;
-        auto musec = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
-        /* Put the elapsed time into the measure array. */
-        results.push_back(musec);
+    for (std::size_t i = 0; i < samples + WARMUP; i++) {
+        auto* f = new future();
+        slot.store(f, std::memory_order_release);
+        // Wait for the waiter to take the future, then give it time to block
+        while (slot.load(std::memory_order_acquire) != nullptr) std::this_thread::yield();
+        std::this_thread::sleep_for(gap);
+        f->put(now_ns());
     }
 
-    print_statistics(results, iters, "Overhead to create/get async");
+    waiter.join();
+    return h;
+}
+
+bool write_csv(const std::string& path, const results& measures) {
+    auto* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) return false;
 
-    return;
+    std::fprintf(file, "benchmark,samples,min_ns,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+    for (const auto& [name, h] : measures) {
+        std::fprintf(file, "%s,%llu,%llu,%.1f,%llu,%llu,%llu,%llu,%llu\n", name.c_str(),
+                     static_cast<unsigned long long>(h.count()),
+                     static_cast<unsigned long long>(h.min()), h.mean(),
+                     static_cast<unsigned long long>(h.percentile(50)),
+                     static_cast<unsigned long long>(h.percentile(90)),
+                     static_cast<unsigned long long>(h.percentile(99)),
+                     static_cast<unsigned long long>(h.percentile(99.9)),
+                     static_cast<unsigned long long>(h.max()));
+    }
+
+    return std::fclose(file) == 0;
 }
 
 int main(int argc, char** argv) {
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    program.add_argument("-n", "--samples")
+        .help("Samples of the fast primitives (pool, queue, barrier); threads, "
+              "asyncs and futures take one hundredth of them")
+        .default_value(1'000'000)
+        .scan<'i', int>();
+
+    program.add_argument("-nw", "--parallel-degree")
+        .help("Workers of the threadpool and parties of the barrier")
+        .default_value(2)
+        .scan<'i', int>();
+
+    program.add_argument("-b", "--benchmark")
+        .help("Benchmark to run: all, thread, async, threadpool, queue, barrier or future")
+        .default_value(std::string{"all"});
+
+    program.add_argument("-g", "--gap")
+        .help("Microseconds the waiter gets to block before each future put")
+        .default_value(20)
+        .scan<'i', int>();
 
-    constexpr uint64_t iters = 128;
+    program.add_argument("-o", "--output")
+        .help("Export the percentiles to a .csv file");
 
-    auto lambda_test = [](int a) -> int {
-        return a;
-    };
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n", err.what());
+        return EXIT_FAILURE;
+    }
+
+    auto samples = program.get<int>("-n");
+    auto nw = program.get<int>("-nw");
+    auto gap = program.get<int>("-g");
+    auto which = program.get<std::string>("-b");
+
+    if (samples <= 0 || nw <= 0 || gap < 0) {
+        std::fprintf(stderr, "Samples and parallel degree must be positive, the gap not negative!\n");
+        return EXIT_FAILURE;
+    }
+
+    auto fast = static_cast<std::size_t>(samples);
+    auto slow = std::max<std::size_t>(fast / 100, 1);
+    auto run = [&](const char* name) { return which == "all" || which == name; };
+
+    results measures;
+    if (run("thread")) measures.emplace_back("thread start/join", bench_thread(slow));
+    if (run("async")) measures.emplace_back("async launch/get", bench_async(slow));
+    if (run("threadpool")) {
+        auto [to_run, to_get] = bench_threadpool(fast, static_cast<unsigned>(nw));
+        measures.emplace_back("threadpool submit-to-run", std::move(to_run));
+        measures.emplace_back("threadpool submit-to-get", std::move(to_get));
+    }
+    if (run("queue")) measures.emplace_back("queue ping-pong round trip", bench_queue(fast));
+    if (run("barrier"))
+        measures.emplace_back("barrier round trip", bench_barrier(fast, static_cast<unsigned>(nw)));
+    if (run("future"))
+        measures.emplace_back("future wake-up",
+                              bench_future(slow, std::chrono::microseconds(gap)));
+
+    if (measures.empty()) {
+        std::fprintf(stderr, "Unknown benchmark: %s\n", which.c_str());
+        return EXIT_FAILURE;
+    }
 
-    run_thread_suite<int, int>(iters, lambda_test, 0xff);
-    run_async_suite<int, int>(iters, lambda_test, 0xff);
+    spm::histogram::print_header();
+    for (const auto& [name, h] : measures) h.print(name.c_str());
 
-    return 0;
-}
\ No newline at end of file
+    if (auto path = program.present<std::string>("-o")) {
+        if (!write_csv(*path, measures)) {
+            std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,20 @@
+#include <assignmentconfig.h>
+
+#include <argparse/argparse.hpp>
+#include <autotuner.hpp>
+#include <scalability.hpp>
+#include <spmutility.hpp>
+#include <test_suite.hpp>
+#include <worker_team.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <thread>
 #include <vector>
 #include <functional>
 
 using float_vector = std::vector<float>;
-using thread_vector = std::vector<std::thread>;
 using float_float_fun = std::function<float(float)>;
 
 enum class spm_mode {
@@ -12,50 +22,34 @@ enum class spm_mode {
     cyclic
 };
 
-float_vector map(const float_vector& v, float_float_fun f, spm_mode mode, int nw) {
+/// Map on a persistent team: no threads are created by the call.
+float_vector map(const float_vector& v, float_float_fun f, spm_mode mode, spm::worker_team& team) {
 
     float_vector result;
-    thread_vector threads;
 
     auto m = v.size();
+    auto nw = team.size();
 
-    result.resize(m); threads.resize(nw);
+    result.resize(m);
 
     switch (mode) {
         case spm_mode::chunk: {
 
-            auto lambda = [&](int start, int end) {
-                for (std::size_t i = start; i <= end; i++) {
+            team.parallel_for(0, m, [&](spm::range r) {
+                for (std::size_t i = r.first; i < r.second; i++) {
                     result[i] = f(v[i]);
                 }
-            };
-
-            int delta = (m / nw);
-            int temp = 0;
-
-            for (std::size_t i = 0 ; i < nw - 1; i++) {
-                threads[i] = std::thread(lambda, temp, temp + delta - 1);
-                temp += delta;
-            }
-            threads[nw - 1] = std::thread(lambda, temp, m - 1);
+            });
 
             break;
         }
         case spm_mode::cyclic: {
-            
-            auto lambda = [&](int index) {
+
+            team.run([&](std::size_t index) {
                 for (std::size_t i = index; i < m; i += nw) {
                     result[i] = f(v[i]);
                 }
-            };
-
-            for (std::size_t i = 0; i < nw; i++) {
-                threads[i] = std::thread(lambda, i);
-            }
-
-            for (std::size_t i = 0; i < nw; i++) {
-                threads[i].join();
-            }
+            });
 
             break;
         }
@@ -64,18 +58,171 @@ float_vector map(const float_vector& v, float_float_fun f, spm_mode mode, int nw
         }
     }
 
+    return result;
+}
 
+float_vector seq_map(const float_vector& v, float_float_fun f) {
+    float_vector result(v.size());
+    std::transform(v.begin(), v.end(), result.begin(), f);
     return result;
 }
 
-int main(void) {
-    
-    float_vector v1 = {1.0, 2.0, 3.0, 4.0};
-    auto v2 = map(v1, [](float x) {return 2 * x; }, spm_mode::cyclic, 2);
+int main(int argc, char** argv) {
+
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    program.add_argument("-s", "--array-size")
+        .help("Number of elements inside the vector")
+        .default_value(1'000'000)
+        .scan<'i', int>();
+
+    program.add_argument("-nw", "--parallel-degree")
+        .help("Parallel degree of the program")
+        .default_value(static_cast<int>(std::thread::hardware_concurrency()))
+        .scan<'i', int>();
+
+    program.add_argument("-m", "--mode")
+        .help("Distribution of the elements to the threads: chunk or cyclic")
+        .default_value(std::string{"chunk"});
+
+    program.add_argument("-r", "--repetitions")
+        .help("Timed repetitions (the minimum when adaptive)")
+        .default_value(5)
+        .scan<'i', int>();
+
+    program.add_argument("--warmup")
+        .help("Untimed runs before the timed ones")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--adaptive")
+        .help("Repeat until the 95% confidence interval is within 2% of the mean")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--sweep")
+        .help("Scalability sweep for nw = 1, ..., the given value (ignores -nw)")
+        .scan<'i', int>();
+
+    program.add_argument("--scaling")
+        .help("Sweep with fixed size (strong), size growing with nw (weak) or both")
+        .default_value(std::string{"both"});
+
+    program.add_argument("--tune")
+        .help("Use the tuned parallel degree of this size and mode, sampling it the first "
+              "time (overrides -nw)")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-o", "--output")
+        .help("Export the measures to a .csv (or .json, without --sweep) file");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
+
+    auto size = program.get<int>("-s");
+    auto nw = program.get<int>("-nw");
+    auto mode_name = program.get<std::string>("-m");
+
+    if (size < 0 || nw < 1) {
+        std::fprintf(stderr, "The size cannot be negative and the parallel degree must be positive!\n");
+        return EXIT_FAILURE;
+    }
+    if (mode_name != "chunk" && mode_name != "cyclic") {
+        std::fprintf(stderr, "Unknown mode: %s\n", mode_name.c_str());
+        return EXIT_FAILURE;
+    }
+    auto mode = (mode_name == "chunk") ? spm_mode::chunk : spm_mode::cyclic;
+
+    spm::suite_options opts;
+    opts.iterations = program.get<int>("-r");
+    opts.warmup = program.get<int>("--warmup");
+    opts.adaptive = program.get<bool>("--adaptive");
+    if (opts.iterations < 1 || opts.warmup < 0) {
+        std::fprintf(stderr, "The repetitions must be positive and the warmup runs "
+                             "not negative!\n");
+        return EXIT_FAILURE;
+    }
+
+    auto f = [](float x) { return std::sqrt(std::abs(std::sin(x) * std::cos(x))); };
+
+    float_vector input, output;
+    auto make_input = [&](std::size_t n) {
+        if (input.size() == n) return;
+        input.resize(n);
+        for (std::size_t i = 0; i < n; i++) input[i] = static_cast<float>(i % 1000);
+    };
+
+    auto measure = [&](std::size_t n, int workers) {
+        make_input(n);
+        if (workers == 0) return spm::test_suite(opts, [&]() { output = seq_map(input, f); });
+
+        // The team is started out of the measured time
+        spm::worker_team team(static_cast<std::size_t>(workers));
+        return spm::test_suite(opts, [&]() { output = map(input, f, mode, team); });
+    };
+
+    if (auto max_nw = program.present<int>("--sweep")) {
+        auto sweep = spm::parse_scaling(program.get<std::string>("--scaling"));
+        if (!sweep || *max_nw < 1) {
+            std::fprintf(stderr, "Invalid sweep: --sweep must be positive and --scaling "
+                                 "one of strong, weak or both\n");
+            return EXIT_FAILURE;
+        }
+        sweep->max_nw = *max_nw;
+        sweep->size = static_cast<std::size_t>(size);
+
+        auto report = spm::scalability_sweep("map_" + mode_name, *sweep, measure);
+        report.print();
+
+        if (auto path = program.present<std::string>("-o")) {
+            if (!report.write_csv(*path)) {
+                std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (program.get<bool>("--tune")) {
+        make_input(size);
+        // The teams are created by the untimed warmup run of each candidate
+        std::map<int, std::unique_ptr<spm::worker_team>> teams;
+        auto run = [&](int workers, std::size_t) {
+            auto& team = teams[workers];
+            if (!team) team = std::make_unique<spm::worker_team>(workers);
+            output = map(input, f, mode, *team);
+        };
+
+        spm::autotuner tuner;
+        auto cached = tuner.lookup("map_" + mode_name, size).has_value();
+        nw = tuner.tune("map_" + mode_name, size, run).nw;
+        std::fprintf(stdout, "Tuned parallel degree (%s): %d\n",
+                     cached ? "from the profile" : "sampled", nw);
+    }
+
+    auto seq = measure(size, 0);
+    auto par = measure(size, nw);
 
-    for (auto& v : v2) {
-        std::fprintf(stdout, "%.2f ", v);
+    spm::benchmark_report report;
+    report.add("seq_map", {{"size", std::to_string(size)}}, seq);
+    report.add("map", {{"size", std::to_string(size)}, {"nw", std::to_string(nw)}, {"mode", mode_name}},
+               par);
+    report.print();
+
+    std::fprintf(stdout, "Speedup (medians): %.2f\n", spm::speedup(seq.median, par.median));
+
+    if (auto path = program.present<std::string>("-o")) {
+        if (!report.write(*path)) {
+            std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+            return EXIT_FAILURE;
+        }
     }
 
-    return 0;
-}
\ No newline at end of file
+    return EXIT_SUCCESS;
+}
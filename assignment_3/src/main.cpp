@@ -1,7 +1,20 @@
 #include <assignmentconfig.h>
 
 #include <argparse/argparse.hpp>
+#include <divide_and_conquer.hpp>
+#include <external_sort.hpp>
+#include <perf_counters.hpp>
+#include <profiler.hpp>
+#include <scalability.hpp>
 #include <spmutility.hpp>
+#include <test_suite.hpp>
+#include <worker_team.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
 
 void seq_odd_even_sort(std::vector<int>& v) noexcept {
     auto n = v.size();
@@ -26,62 +39,176 @@ void seq_odd_even_sort(std::vector<int>& v) noexcept {
     }
 }
 
+/// Odd-even sort on a persistent team: each member sorts a partition and the
+/// phases are separated by the team barrier, no threads are created.
 template <spm::Ord T>
-void par_odd_even_sort(std::vector<T>& v, uint16_t nw) noexcept {
-    using thread = std::thread;
-    using range = std::pair<std::size_t, std::size_t>;
-
-    std::barrier sync_point(nw);
+void par_odd_even_sort(std::vector<T>& v, spm::worker_team& team) noexcept {
+    // Whether someone swapped in the current round. Two flags used in turns,
+    // so the next one can be reset while the current one is still being read.
+    std::atomic<bool> swapped[2] = {false, false};
 
-    std::vector<thread> threads;
-    std::vector<range> ranges;
-    threads.resize(nw);
-    ranges.resize(nw);
-
-    // For now, let's suppose that the array size is even...
     auto n = v.size();
-    auto delta = n / nw;
+    auto ranges = spm::block_partition(0, n, team.size());
 
-    auto phases = [&](const range& r) {
-        bool sorted = false;
+    auto phases = [&](std::size_t id) {
+        SPM_PROFILE_SCOPE("par_odd_even_sort");
+        const auto& r = ranges[id];
+        // Compare v[i] with v[i + 1] only inside the vector
+        auto last = std::min(r.second, n - 1);
+        // Phases use the global parity of i, so each pair belongs to one thread
+        auto first_odd = r.first | 1;
+        auto first_even = r.first + (r.first & 1);
 
-        while (!sorted) {
-            sorted = true;
+        for (std::size_t round = 0;; round ^= 1) {
+            bool sorted = true;
 
             // Odd phase
-            for (std::size_t i = r.first + 1; i < r.second; i += 2) {
-                if (v[i] > v[i + 1]) {
-                    spm::swap(v[i], v[i + 1]);
-                    sorted = false;
+            {
+                SPM_PROFILE_SCOPE("odd phase");
+                for (std::size_t i = first_odd; i < last; i += 2) {
+                    if (v[i] > v[i + 1]) {
+                        spm::swap(v[i], v[i + 1]);
+                        sorted = false;
+                    }
                 }
             }
             // Wait for all the threads finishing sorting their partitions (odd)
-            sync_point.arrive_and_wait();
+            {
+                SPM_PROFILE_SCOPE("odd barrier");
+                team.sync();
+            }
+            swapped[round ^ 1].store(false, std::memory_order_relaxed);
 
             // Even phase
-            for (std::size_t i = r.first; i < r.second; i += 2) {
-                if (v[i] > v[i + 1]) {
-                    spm::swap(v[i], v[i + 1]);
-                    sorted = false;
+            {
+                SPM_PROFILE_SCOPE("even phase");
+                for (std::size_t i = first_even; i < last; i += 2) {
+                    if (v[i] > v[i + 1]) {
+                        spm::swap(v[i], v[i + 1]);
+                        sorted = false;
+                    }
                 }
             }
+            if (!sorted) swapped[round].store(true, std::memory_order_relaxed);
             // Wait for all the threads finishing sorting their partitions
             // (even)
-            sync_point.arrive_and_wait();
-        }
+            {
+                SPM_PROFILE_SCOPE("even barrier");
+                team.sync();
+            }
 
-        // Thread partion is sorted, the thread can drop the barriers
-        sync_point.arrive_and_drop();
+            // A partition can be unsorted again by its neighbours: stop only
+            // when nobody swapped during the whole round
+            if (!swapped[round].load(std::memory_order_relaxed)) break;
+        }
     };
 
-    for (std::size_t i = 0; i < nw; i++) {
-        ranges[i] = range((i * delta), (i != nw - 1) ? (i + 1) * delta : n);
-        threads[i] = thread(phases, ranges[i]);
+    team.run(phases);
+}
+
+/// Below this size the divide and conquer sorts use std::sort.
+constexpr std::size_t DC_BASE_SIZE = 64;
+
+/// Quicksort as a divide and conquer: a three way partition around the
+/// median of three, the equal keys are already in place.
+template <spm::Ord T>
+void dc_quicksort(std::vector<T>& v, spm::threadpool& pool, spm::dc_cutoff& cutoff) {
+    using slice = std::span<T>;
+
+    spm::divide_and_conquer(
+        pool, slice{v}, [](slice s) { return s.size() <= DC_BASE_SIZE; },
+        [](slice s) {
+            std::sort(s.begin(), s.end());
+            return s;
+        },
+        [](slice s) {
+            auto a = s[0], b = s[s.size() / 2], c = s[s.size() - 1];
+            auto pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+            auto lt = std::partition(s.begin(), s.end(), [&](const T& x) { return x < pivot; });
+            auto gt = std::partition(lt, s.end(), [&](const T& x) { return !(pivot < x); });
+            return std::vector<slice>{s.first(lt - s.begin()), s.last(s.end() - gt)};
+        },
+        [](std::vector<slice> parts) {
+            // The sorted parts with the pivots in between
+            auto end = parts[1].data() + parts[1].size();
+            return slice{parts[0].data(), static_cast<std::size_t>(end - parts[0].data())};
+        },
+        cutoff);
+}
+
+/// Mergesort as a divide and conquer: halves merged in place.
+template <spm::Ord T>
+void dc_mergesort(std::vector<T>& v, spm::threadpool& pool, spm::dc_cutoff& cutoff) {
+    using slice = std::span<T>;
+
+    spm::divide_and_conquer(
+        pool, slice{v}, [](slice s) { return s.size() <= DC_BASE_SIZE; },
+        [](slice s) {
+            std::sort(s.begin(), s.end());
+            return s;
+        },
+        [](slice s) {
+            auto half = s.size() / 2;
+            return std::vector<slice>{s.first(half), s.subspan(half)};
+        },
+        [](std::vector<slice> halves) {
+            slice whole{halves[0].data(), halves[0].size() + halves[1].size()};
+            std::inplace_merge(whole.begin(), whole.begin() + halves[0].size(), whole.end());
+            return whole;
+        },
+        cutoff);
+}
+
+/// Write count random ints to path, through a writable mapping so that the
+/// input can be larger than the memory.
+bool generate_input_file(const std::string& path, std::size_t count, std::uint64_t seed,
+                         spm::distribution dist) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    auto bytes = count * sizeof(int);
+    bool ok = ::ftruncate(fd, static_cast<off_t>(bytes)) == 0;
+    if (ok && bytes > 0) {
+        auto* data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ok = data != MAP_FAILED;
+        if (ok) {
+            spm::random_fill({static_cast<int*>(data), count}, 0, 1000, seed, dist);
+            ok = ::munmap(data, bytes) == 0;
+        }
+    }
+    return ::close(fd) == 0 && ok;
+}
+
+/// Out-of-core sort of a binary file of ints (see spm::external_sort).
+int sort_file(const std::string& input, const std::string& output, std::size_t memory, int nw,
+              bool check) {
+    spm::worker_team team(static_cast<std::size_t>(nw));
+    spm::external_sort_options options;
+    options.memory = memory;
+
+    auto report = spm::external_sort<int>(input, output, team, options);
+    if (!report.error.empty()) {
+        std::fprintf(stderr, "External sort failed: %s\n", report.error.c_str());
+        return EXIT_FAILURE;
     }
 
-    for (auto& t : threads) t.join();
+    auto mb = static_cast<double>(report.elements * sizeof(int)) / (1 << 20);
+    auto total = report.run_time + report.merge_time;
+    std::fprintf(stdout, "Sorted %zu elements (%.1f MB) in %zu runs\n", report.elements, mb,
+                 report.runs);
+    std::fprintf(stdout, "Runs: %.3f s, merge: %.3f s, total: %.3f s (%.1f MB/s)\n",
+                 report.run_time.count(), report.merge_time.count(), total.count(),
+                 total.count() > 0 ? mb / total.count() : 0.0);
 
-    return;
+    if (check) {
+        spm::mapped_file sorted(output);
+        auto v = sorted.as<int>();
+        sorted.advise(0, sorted.size(), MADV_SEQUENTIAL);
+        auto ok = sorted.ok() && v.size() == report.elements && std::is_sorted(v.begin(), v.end());
+        std::fprintf(stdout, "Is %s sorted? %s\n", output.c_str(), ok ? "Yes" : "No");
+        if (!ok) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char** argv) {
@@ -100,6 +227,70 @@ int main(int argc, char** argv) {
         .default_value(DEFAULT_PARALLEL_DEGREE)
         .scan<'i', int>();
 
+    program.add_argument("--seed")
+        .help("Seed of the random input (a random one if missing)")
+        .scan<'i', long long>();
+
+    program.add_argument("-d", "--distribution")
+        .help("Input shape: uniform, sorted, reverse, nearly or few")
+        .default_value(std::string{"uniform"});
+
+    program.add_argument("-r", "--repetitions")
+        .help("Timed repetitions of each sort (the minimum when adaptive)")
+        .default_value(5)
+        .scan<'i', int>();
+
+    program.add_argument("--warmup")
+        .help("Untimed runs before the timed ones")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--adaptive")
+        .help("Repeat until the 95% confidence interval is within 2% of the mean")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-o", "--output")
+        .help("Export the measures to a .csv or .json file");
+
+    program.add_argument("--sweep")
+        .help("Scalability sweep for nw = 1, ..., the given value (ignores -nw)")
+        .scan<'i', int>();
+
+    program.add_argument("--scaling")
+        .help("Sweep with fixed size (strong), size growing with nw (weak) or both")
+        .default_value(std::string{"both"});
+
+    program.add_argument("--perf")
+        .help("Measure hardware counters (IPC, cache and branch misses) of one more run of each sort")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-i", "--input")
+        .help("Sort this binary file of ints out of core instead of benchmarking");
+
+    program.add_argument("--output-file")
+        .help("Where to write the sorted --input (<input>.sorted by default)");
+
+    program.add_argument("--memory")
+        .help("Memory for sorting --input, in MiB (half of the RAM by default)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--generate")
+        .help("Write this many random ints (--seed, -d) to --input before sorting it")
+        .scan<'i', long long>();
+
+    program.add_argument("--check")
+        .help("Verify that the sorted --input is sorted")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--profile")
+        .help("Print the time spent in the phases and barriers of the parallel sort at exit")
+        .default_value(false)
+        .implicit_value(true);
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error& err) {
@@ -120,28 +311,149 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    auto seq_time = 0L;
-    auto par_time = 0L;
-    auto v1 = spm::gen_random_int_vector(vector_size, 0, 1000);
-    auto v2 = spm::gen_random_int_vector(vector_size, 0, 1000);
+    if (program.get<bool>("--profile")) {
+        spm::profiler::instance().enable_report_at_exit(stdout);
+    }
+
+    auto dist = spm::parse_distribution(program.get<std::string>("-d"));
+    if (!dist) {
+        std::fprintf(stderr, "Unknown distribution: %s\n",
+                     program.get<std::string>("-d").c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::uint64_t seed = std::random_device{}();
+    if (auto v = program.present<long long>("--seed")) {
+        seed = static_cast<std::uint64_t>(*v);
+    }
+    std::fprintf(stdout, "Input seed: %llu\n", static_cast<unsigned long long>(seed));
+
+    if (auto input = program.present<std::string>("-i")) {
+        if (auto count = program.present<long long>("--generate")) {
+            if (*count < 0 || !generate_input_file(*input, *count, seed, *dist)) {
+                std::fprintf(stderr, "Cannot generate %lld ints in %s\n", *count, input->c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        auto memory = program.get<int>("--memory");
+        if (nw < 1 || memory < 0) {
+            std::fprintf(stderr, "The parallel degree must be positive and the memory not negative!\n");
+            return EXIT_FAILURE;
+        }
+        auto output = program.present<std::string>("--output-file").value_or(*input + ".sorted");
+        return sort_file(*input, output, static_cast<std::size_t>(memory) << 20, nw,
+                         program.get<bool>("--check"));
+    }
 
-    {
-        spm::utimer t{"Sorting a vector using seq_odd_event_sort", &seq_time};
-        seq_odd_even_sort(v1);
+    spm::suite_options opts;
+    opts.iterations = program.get<int>("-r");
+    opts.warmup = program.get<int>("--warmup");
+    opts.adaptive = program.get<bool>("--adaptive");
+    if (opts.iterations < 1 || opts.warmup < 0) {
+        std::fprintf(stderr, "The repetitions must be positive and the warmup runs "
+                             "not negative!\n");
+        return EXIT_FAILURE;
     }
 
-    {
-        spm::utimer t{"Sorting a vector using par_odd_event_sort", &par_time};
-        par_odd_even_sort(v2, static_cast<uint16_t>(nw));
+    if (auto max_nw = program.present<int>("--sweep")) {
+        auto sweep = spm::parse_scaling(program.get<std::string>("--scaling"));
+        if (!sweep || *max_nw < 1) {
+            std::fprintf(stderr, "Invalid sweep: --sweep must be positive and --scaling "
+                                 "one of strong, weak or both\n");
+            return EXIT_FAILURE;
+        }
+        sweep->max_nw = *max_nw;
+        sweep->size = static_cast<std::size_t>(vector_size);
+
+        std::vector<int> input, v;
+        auto measure = [&](std::size_t size, int nw) {
+            if (input.size() != size) input = spm::gen_random_int_vector(size, 0, 1000, seed, *dist);
+            if (nw == 0) {
+                return spm::test_suite(opts, [&]() { v = input; }, [&]() { seq_odd_even_sort(v); });
+            }
+            // The team is started out of the measured time
+            spm::worker_team team(static_cast<std::size_t>(nw));
+            return spm::test_suite(opts, [&]() { v = input; }, [&]() { par_odd_even_sort(v, team); });
+        };
+
+        auto report = spm::scalability_sweep("odd_even_sort", *sweep, measure);
+        report.print();
+
+        if (auto path = program.present<std::string>("-o")) {
+            if (!report.write_csv(*path)) {
+                std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
     }
 
-    std::fprintf(stdout, "Total speedup: %.2f\n",
-                 spm::speedup(static_cast<double>(seq_time),
-                              static_cast<double>(par_time)));
+    // Both versions sort the same input, restored before each repetition
+    auto input = spm::gen_random_int_vector(vector_size, 0, 1000, seed, *dist);
+    auto v1 = input;
+    auto v2 = input;
+
+    auto seq = spm::test_suite(
+        opts, [&]() { v1 = input; }, [&]() { seq_odd_even_sort(v1); });
+    spm::worker_team team(static_cast<std::size_t>(nw));
+    auto par = spm::test_suite(
+        opts, [&]() { v2 = input; }, [&]() { par_odd_even_sort(v2, team); });
+
+    // The divide and conquer sorts, on a pool keeping their cutoffs across the repetitions
+    spm::threadpool pool(static_cast<unsigned>(std::max(nw, 1)));
+    spm::dc_cutoff quicksort_cutoff, mergesort_cutoff;
+    auto v3 = input;
+    auto quick = spm::test_suite(
+        opts, [&]() { v3 = input; }, [&]() { dc_quicksort(v3, pool, quicksort_cutoff); });
+    auto v4 = input;
+    auto merge = spm::test_suite(
+        opts, [&]() { v4 = input; }, [&]() { dc_mergesort(v4, pool, mergesort_cutoff); });
+    pool.shutdown();
+
+    spm::benchmark_report report;
+    report.add("seq_odd_even_sort", {{"size", std::to_string(vector_size)}}, seq);
+    report.add("par_odd_even_sort",
+               {{"size", std::to_string(vector_size)}, {"nw", std::to_string(nw)}}, par);
+    report.add("dc_quicksort", {{"size", std::to_string(vector_size)}, {"nw", std::to_string(nw)}},
+               quick);
+    report.add("dc_mergesort", {{"size", std::to_string(vector_size)}, {"nw", std::to_string(nw)}},
+               merge);
+    report.print();
+
+    std::fprintf(stdout, "Total speedup (medians): %.2f\n",
+                 spm::speedup(seq.median, par.median));
+
+    if (program.get<bool>("--perf")) {
+        // Process wide, to count the threads spawned by the parallel sort too
+        spm::perf_counters counters;
+        if (!counters.available()) {
+            std::fprintf(stderr, "Hardware counters unavailable: %s\n",
+                         counters.error().c_str());
+        } else {
+            v1 = input;
+            counters.measure([&]() { seq_odd_even_sort(v1); }).print("seq_odd_even_sort");
+            // A new team, whose threads are spawned after the counters
+            spm::worker_team counted_team(static_cast<std::size_t>(nw));
+            v2 = input;
+            counters.measure([&]() { par_odd_even_sort(v2, counted_team); })
+                .print("par_odd_even_sort");
+        }
+    }
     std::cout << "Is v1 sorted? "
               << (std::is_sorted(v1.begin(), v1.end()) ? "Yes" : "No") << "\n";
     std::cout << "Is v2 sorted? "
               << (std::is_sorted(v2.begin(), v2.end()) ? "Yes" : "No") << "\n";
+    std::cout << "Is v3 sorted? "
+              << (std::is_sorted(v3.begin(), v3.end()) ? "Yes" : "No") << "\n";
+    std::cout << "Is v4 sorted? "
+              << (std::is_sorted(v4.begin(), v4.end()) ? "Yes" : "No") << "\n";
+
+    if (auto path = program.present<std::string>("-o")) {
+        if (!report.write(*path)) {
+            std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+            return EXIT_FAILURE;
+        }
+    }
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
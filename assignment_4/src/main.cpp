@@ -2,8 +2,61 @@
 
 #include <argparse/argparse.hpp>
 #include <spmutility.hpp>
+#include <task_graph.hpp>
 #include <threadpool.hpp>
 
+#include <numeric>
+
+/***
+ * Batch job as a task graph: two halves of the input are generated and
+ * sorted independently, then merged, prefix summed and written. The graph
+ * is declared once and run the given number of times.
+ */
+void run_batch_graph(spm::threadpool &pool, std::size_t size, int runs) {
+    auto half = size / 2;
+    std::vector<int> input(size), sorted(size);
+    std::vector<long long> prefix(size);
+    long long checksum = 0;
+
+    spm::task_graph graph;
+    auto gen_left = graph.add(
+        [&]() { spm::random_fill({input.data(), half}, 0, 1000, 1); }, "generate left");
+    auto gen_right = graph.add(
+        [&]() { spm::random_fill({input.data() + half, size - half}, 0, 1000, 2); },
+        "generate right");
+    auto sort_left = graph.add(
+        [&]() { std::sort(input.begin(), input.begin() + half); }, "sort left");
+    auto sort_right = graph.add(
+        [&]() { std::sort(input.begin() + half, input.end()); }, "sort right");
+    auto merge = graph.add(
+        [&]() {
+            std::merge(input.begin(), input.begin() + half, input.begin() + half, input.end(),
+                       sorted.begin());
+        },
+        "merge");
+    auto scan = graph.add(
+        [&]() {
+            std::inclusive_scan(sorted.begin(), sorted.end(), prefix.begin(),
+                                std::plus<long long>{});
+        },
+        "scan");
+    auto write = graph.add([&]() { checksum = prefix.empty() ? 0 : prefix.back(); }, "write");
+
+    graph.precede(gen_left, sort_left);
+    graph.precede(gen_right, sort_right);
+    graph.precede(sort_left, merge);
+    graph.precede(sort_right, merge);
+    graph.precede(merge, scan);
+    graph.precede(scan, write);
+
+    for (int r = 0; r < runs; r++) {
+        spm::utimer timer("task graph run");
+        graph.run(pool);
+    }
+    std::cout << "Sorted: " << (std::is_sorted(sorted.begin(), sorted.end()) ? "Yes" : "No")
+              << ", checksum: " << checksum << "\n";
+}
+
 int main(int argc, char **argv) {
     using namespace std::chrono_literals;
 
@@ -15,6 +68,27 @@ int main(int argc, char **argv) {
         .default_value(nw)
         .scan<'i', int>();
 
+    program.add_argument("--max-workers")
+        .help("Make the pool elastic between -nw and this many workers, and run a burst of tasks")
+        .scan<'i', int>();
+
+    program.add_argument("--idle-ms")
+        .help("Idle time after which an elastic worker retires (ms)")
+        .default_value(200)
+        .scan<'i', int>();
+
+    program.add_argument("--graph")
+        .help("Run a generate, sort, merge, scan, write task graph on this many ints")
+        .scan<'i', int>();
+
+    program.add_argument("--metrics")
+        .help("Append the metrics of the pool to this file every --metrics-ms, and print them at the end");
+
+    program.add_argument("--metrics-ms")
+        .help("Interval of the metrics dumps (ms)")
+        .default_value(1000)
+        .scan<'i', int>();
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -23,7 +97,52 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
+    if (auto max_workers = program.present<int>("--max-workers")) {
+        spm::elastic_options bounds;
+        bounds.min_workers = program.get<int>("-nw");
+        bounds.max_workers = *max_workers;
+        bounds.idle_timeout = 1ms * program.get<int>("--idle-ms");
+        spm::threadpool pool(bounds);
+        auto metrics_path = program.present<std::string>("--metrics");
+        if (metrics_path && !pool.dump_metrics(*metrics_path, 1ms * program.get<int>("--metrics-ms"))) {
+            std::fprintf(stderr, "Cannot write the metrics to %s\n", metrics_path->c_str());
+        }
+
+        // A burst of short tasks grows the pool, the idle time shrinks it back
+        constexpr auto BURST = 256;
+        std::vector<std::shared_ptr<spm::future<int>>> results;
+        for (int i = 0; i < BURST; i++) {
+            results.push_back(pool.submit(
+                [](int i) -> int {
+                    std::this_thread::sleep_for(5ms);
+                    return i;
+                },
+                i));
+        }
+        std::cout << "Workers during the burst: " << pool.size() << "\n";
+        for (auto &r : results) r->get();
+
+        std::this_thread::sleep_for(bounds.idle_timeout * 3);
+        std::cout << "Workers after " << 3 * bounds.idle_timeout.count()
+                  << "ms idle: " << pool.size() << "\n";
+
+        pool.shutdown();
+        if (metrics_path) pool.metrics().print();
+        return EXIT_SUCCESS;
+    }
+
     spm::threadpool pool(program.get<int>("-nw"));
+    auto metrics_path = program.present<std::string>("--metrics");
+    if (metrics_path && !pool.dump_metrics(*metrics_path, 1ms * program.get<int>("--metrics-ms"))) {
+        std::fprintf(stderr, "Cannot write the metrics to %s\n", metrics_path->c_str());
+    }
+
+    if (auto size = program.present<int>("--graph")) {
+        run_batch_graph(pool, static_cast<std::size_t>(std::max(*size, 0)), 3);
+        pool.shutdown();
+        if (metrics_path) pool.metrics().print();
+        return EXIT_SUCCESS;
+    }
     auto task_3s = pool.submit(
         [](int time) -> int {
             std::this_thread::sleep_for(1s * time);
@@ -34,6 +153,7 @@ int main(int argc, char **argv) {
     std::cout << "Value got: " << task_3s->get() << "\n";
 
     pool.shutdown();
+    if (metrics_path) pool.metrics().print();
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -1,39 +1,166 @@
 #include <spmutility.hpp>
 #include <assignmentconfig.h>
 #include <argparse/argparse.hpp>
+#include <kernels.hpp>
+#include <perf_counters.hpp>
+#include <scalability.hpp>
+#include <test_suite.hpp>
 
 #include <omp.h>
 
-std::vector<int> sum(std::vector<int>& a, std::vector<int> b) {
+/// c = a + b, with no copies of the inputs and a caller provided output (c may be a or b).
+void sum(std::span<const int> a, std::span<const int> b, std::span<int> c) {
+    spm::kernels::add(a, b, c);
+}
 
-    std::vector<int> c(a.size());
+int main(int argc, char** argv, char** envs) {
 
-    #pragma omp parallel for
-    for (std::size_t i = 0; i < a.size(); i++) {
-        c[i] = a[i] + b[i];
-    }
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
 
-    return c;
-}
+    // Vectors of 4 times the last level cache stream from memory; the three
+    // of them take at most a quarter of the physical memory
+    auto default_bytes = std::min(4 * spm::get_llc_size(), spm::get_physical_memory() / 12);
+    program.add_argument("-n", "--size")
+        .help("Elements of each vector (default 4 times the last level cache)")
+        .default_value(static_cast<long long>(default_bytes / sizeof(int)))
+        .scan<'i', long long>();
 
-int main(int argc, char** argv, char** envs) {
+    program.add_argument("-r", "--repetitions")
+        .help("Timed repetitions (the minimum when adaptive)")
+        .default_value(5)
+        .scan<'i', int>();
+
+    program.add_argument("--warmup")
+        .help("Untimed runs before the timed ones")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--adaptive")
+        .help("Repeat until the 95% confidence interval is within 2% of the mean")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-o", "--output")
+        .help("Export the measures to a .csv or .json file");
+
+    program.add_argument("--sweep")
+        .help("Scalability sweep for 1, ..., the given number of OpenMP threads")
+        .scan<'i', int>();
+
+    program.add_argument("--scaling")
+        .help("Sweep with fixed size (strong), size growing with the threads (weak) or both")
+        .default_value(std::string{"both"});
+
+    program.add_argument("--perf")
+        .help("Measure hardware counters (IPC, cache and branch misses) of one more sum")
+        .default_value(false)
+        .implicit_value(true);
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
 
     // Prints out: OMP_NUM_THREADS
     if (const char* env_omp = std::getenv("OMP_NUM_THREADS"))
         std::cout << "OMP_NUM_THREADS: " << env_omp << '\n';
 
-    long elapsed = 0;
-    auto amount = spm::get_cache_line_size() * 10'000'000;
+    // Counters follow only the threads spawned after their creation, so open
+    // them before the first parallel region starts the OpenMP pool
+    std::optional<spm::perf_counters> counters;
+    if (program.get<bool>("--perf")) counters.emplace();
 
-    auto a = spm::gen_random_int_vector(amount, 0, 10000);
-    auto b = spm::gen_random_int_vector(amount, 0, 10000);
+    if (program.get<long long>("-n") <= 0) {
+        std::fprintf(stderr, "The size must be positive!\n");
+        return EXIT_FAILURE;
+    }
+    auto amount = static_cast<std::size_t>(program.get<long long>("-n"));
 
-    {
-        spm::utimer timer("Parallel sum of elements", &elapsed);
-        auto _ = sum(a, b);
+    // Reproducible inputs, generated in parallel by the threads which will
+    // use them in the sum, so their pages are first touched on their NUMA node
+    constexpr std::uint64_t seed = 2122;
+    spm::aligned_vector<int> a(amount), b(amount), c(amount);
+    spm::kernels::first_touch(std::span<int>{a},
+                              [&](std::size_t i) { return spm::uniform_at(seed, i, 0, 10000); });
+    spm::kernels::first_touch(std::span<int>{b},
+                              [&](std::size_t i) { return spm::uniform_at(seed + 1, i, 0, 10000); });
+    spm::kernels::first_touch(std::span<int>{c});
+
+    spm::suite_options opts;
+    opts.iterations = program.get<int>("-r");
+    opts.warmup = program.get<int>("--warmup");
+    opts.adaptive = program.get<bool>("--adaptive");
+    if (opts.iterations < 1 || opts.warmup < 0) {
+        std::fprintf(stderr, "The repetitions must be positive and the warmup runs "
+                             "not negative!\n");
+        return EXIT_FAILURE;
     }
 
-    std::cout << "Total amount of seconds: " << spm::utimer::to_seconds(elapsed) << "s\n";
+    if (auto max_nw = program.present<int>("--sweep")) {
+        auto sweep = spm::parse_scaling(program.get<std::string>("--scaling"));
+        if (!sweep || *max_nw < 1) {
+            std::fprintf(stderr, "Invalid sweep: --sweep must be positive and --scaling "
+                                 "one of strong, weak or both\n");
+            return EXIT_FAILURE;
+        }
+        sweep->max_nw = *max_nw;
+        sweep->size = amount;
+
+        // Smaller problems use the first elements of the vectors
+        auto sweep_measure = [&](std::size_t size, int nw) {
+            auto x = std::span<const int>{a}.first(size);
+            auto y = std::span<const int>{b}.first(size);
+            auto z = std::span<int>{c}.first(size);
+            if (nw == 0) {
+                return spm::test_suite(opts, [&]() {
+                    std::transform(x.begin(), x.end(), y.begin(), z.begin(), std::plus<>{});
+                });
+            }
+            omp_set_num_threads(nw);
+            return spm::test_suite(opts, [&]() { sum(x, y, z); });
+        };
+
+        auto report = spm::scalability_sweep("sum", *sweep, sweep_measure);
+        report.print();
+
+        if (auto path = program.present<std::string>("-o")) {
+            if (!report.write_csv(*path)) {
+                std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    auto measure = spm::test_suite(opts, [&]() { sum(a, b, c); });
+
+    spm::benchmark_report report;
+    report.add("sum", {{"size", std::to_string(amount)}}, measure);
+    report.print();
+
+    // Two arrays read and one written
+    auto bytes = 3.0 * static_cast<double>(amount * sizeof(int));
+    std::cout << "Median time: " << measure.median / 1e6 << "s\n";
+    std::cout << "Bandwidth: " << bytes / (measure.median * 1e3) << " GB/s\n";
+
+    if (counters) {
+        if (!counters->available()) {
+            std::fprintf(stderr, "Hardware counters unavailable: %s\n",
+                         counters->error().c_str());
+        } else {
+            counters->measure([&]() { sum(a, b, c); }).print("sum");
+        }
+    }
+
+    if (auto path = program.present<std::string>("-o")) {
+        if (!report.write(*path)) {
+            std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+            return EXIT_FAILURE;
+        }
+    }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
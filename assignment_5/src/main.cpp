@@ -1,52 +1,203 @@
 #include <spmutility.hpp>
 #include <assignmentconfig.h>
 #include <argparse/argparse.hpp>
+#include <tracing.hpp>
+#include <workload.hpp>
+
+#include <atomic>
 
 #include <omp.h>
 
-void execute_farm(std::size_t par_degree, std::size_t tasks, const std::chrono::nanoseconds& ta,  const std::chrono::nanoseconds& ts) {
+/// What the emitter does when the in-flight window is full.
+enum class backpressure { block, drop };
+
+struct farm_report {
+    std::size_t completed = 0;
+    std::size_t dropped = 0;
+    std::chrono::nanoseconds elapsed{0};
+};
+
+/***
+ * Farm with an emitter producing a task every ta and workers spending ts on each one,
+ * doing the synthetic work of model. At most window tasks can be in flight (emitted
+ * but not completed), 0 means unbounded.
+ */
+farm_report execute_farm(std::size_t par_degree, std::size_t tasks, const std::chrono::nanoseconds& ta,  const std::chrono::nanoseconds& ts,
+                         const spm::workload::task_model& model, std::size_t window, backpressure policy,
+                         spm::tracer& tracer) {
+
+    using event = spm::tracer::event;
+
+    farm_report report;
+    std::atomic<std::size_t> in_flight{0};
+    std::atomic<std::size_t> completed{0};
+
+    auto start = std::chrono::steady_clock::now();
 
     #pragma omp parallel num_threads(par_degree)
     {
+        // Calibrate and allocate the working set of each thread before the first task
+        model.prepare();
+
         #pragma omp single
         {
             // Emit new tasks
             for (std::size_t i = 0; i < tasks; i++) {
 
-                #pragma omp task
-                {
-                    #pragma omp critical
-                    {
-                        std::cout << "Thread " << omp_get_thread_num() << ": executing task " << i << "...\n";
+                if (window > 0 && in_flight.load(std::memory_order_acquire) >= window) {
+                    if (policy == backpressure::drop) {
+                        report.dropped++;
+                        std::this_thread::sleep_for(ta);
+                        continue;
                     }
-                    spm::active_delay(ts); // Fake the computation of a task
-                    #pragma omp critical
-                    {
-                        std::cout << "Thread " << omp_get_thread_num() << ": task " << i << " done!\n";
+                    // Block the emitter until a slot is free, running queued
+                    // tasks meanwhile: with one thread nobody else would. libgomp
+                    // implements taskyield as a no-op, so alone in the team the
+                    // emitter runs them with taskwait (which drains the window)
+                    while (in_flight.load(std::memory_order_acquire) >= window) {
+                        if (omp_get_num_threads() == 1) {
+                            #pragma omp taskwait
+                        } else {
+                            #pragma omp taskyield
+                        }
                     }
                 }
 
+                in_flight.fetch_add(1, std::memory_order_relaxed);
+                tracer.trace(omp_get_thread_num(), i, event::emit);
+
+                #pragma omp task
+                {
+                    tracer.trace(omp_get_thread_num(), i, event::start);
+                    model(ts); // Fake the computation of a task
+                    tracer.trace(omp_get_thread_num(), i, event::end);
+
+                    completed.fetch_add(1, std::memory_order_relaxed);
+                    in_flight.fetch_sub(1, std::memory_order_release);
+                }
+
                 // Wait to emit a new task
-                std::this_thread::sleep_for(ta); // Emit a new task half a second
+                std::this_thread::sleep_for(ta);
             }
             #pragma omp taskwait
             std::cout << "All tasks were completed!\n";
         }
     }
+
+    report.elapsed = std::chrono::steady_clock::now() - start;
+    report.completed = completed.load();
+
+    return report;
 }
 
 int main(int argc, char** argv) {
 
-    using namespace std::chrono_literals;
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    program.add_argument("-nw", "--parallel-degree")
+        .help("Parallel degree of the farm")
+        .default_value(omp_get_max_threads())
+        .scan<'i', int>();
+
+    program.add_argument("-n", "--tasks")
+        .help("Number of tasks emitted")
+        .default_value(16)
+        .scan<'i', int>();
+
+    program.add_argument("-ta", "--inter-arrival")
+        .help("Inter-arrival time of the tasks (msecs)")
+        .default_value(250)
+        .scan<'i', int>();
+
+    program.add_argument("-ts", "--service-time")
+        .help("Service time of each task (msecs)")
+        .default_value(10'000)
+        .scan<'i', int>();
+
+    program.add_argument("-k", "--kernel")
+        .help("Work of the tasks: compute, stream, chase (pointer chasing) or mixed")
+        .default_value(std::string{"compute"});
+
+    program.add_argument("--working-set")
+        .help("Working set of each worker for the memory bound kernels (KiB)")
+        .default_value(1024)
+        .scan<'i', int>();
+
+    program.add_argument("-w", "--window")
+        .help("Maximum number of tasks in flight (0 means unbounded)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("-p", "--policy")
+        .help("What to do when the window is full: block or drop")
+        .default_value(std::string{"block"});
+
+    program.add_argument("-t", "--trace")
+        .help("Prefix of the trace files (<prefix>.json and <prefix>.csv)")
+        .default_value(std::string{"farm_trace"});
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
+
+    auto nw = program.get<int>("-nw");
+    auto tasks = program.get<int>("-n");
+    auto ta = std::chrono::milliseconds(program.get<int>("-ta"));
+    auto ts = std::chrono::milliseconds(program.get<int>("-ts"));
+    auto window = program.get<int>("-w");
+    auto policy_name = program.get<std::string>("-p");
+
+    if (nw <= 0 || tasks < 0 || window < 0 || ta.count() < 0 || ts.count() < 0) {
+        std::fprintf(stderr, "The farm parameters cannot be less than zero!\n");
+        return EXIT_FAILURE;
+    }
+    if (policy_name != "block" && policy_name != "drop") {
+        std::fprintf(stderr, "Unknown backpressure policy: %s\n", policy_name.c_str());
+        return EXIT_FAILURE;
+    }
+    auto policy = (policy_name == "drop") ? backpressure::drop : backpressure::block;
+
+    auto kind = spm::workload::parse_kind(program.get<std::string>("-k"));
+    auto working_set = program.get<int>("--working-set");
+    if (!kind || working_set <= 0) {
+        std::fprintf(stderr, "Unknown kernel %s or non positive working set\n",
+                     program.get<std::string>("-k").c_str());
+        return EXIT_FAILURE;
+    }
+    spm::workload::task_model model(*kind, static_cast<std::size_t>(working_set) * 1024);
 
     // Prints out: OMP_NUM_THREADS
     if (const char* env_omp = std::getenv("OMP_NUM_THREADS"))
         std::cout << "OMP_NUM_THREADS: " << env_omp << '\n';
 
-    auto workers = omp_get_max_threads();
-    std::cout << "The current node can use up to " << workers << " threads!\n";
+    std::cout << "The current node can use up to " << omp_get_max_threads() << " threads!\n";
+
+    spm::tracer tracer(nw);
+    auto report = execute_farm(nw, tasks, ta, ts, model, window, policy, tracer);
 
-    execute_farm(workers, 16, 250ms, 10s);
+    // Ideal completion time: the farm is bound either by the emitter or by the workers
+    using msecs = std::chrono::duration<double, std::milli>;
+    auto emitter_bound = msecs(ta) * tasks;
+    auto workers_bound = msecs(ts) * static_cast<double>(report.completed) / nw;
+    auto ideal = std::max(emitter_bound, workers_bound);
+    auto measured = std::chrono::duration_cast<msecs>(report.elapsed);
+
+    std::fprintf(stdout, "Completed %zu tasks, dropped %zu\n", report.completed, report.dropped);
+    std::fprintf(stdout, "Completion time: %.2f ms (ideal %.2f ms, efficiency %.2f)\n",
+                 measured.count(), ideal.count(),
+                 measured.count() > 0 ? ideal.count() / measured.count() : 0.0);
+
+    // Flush the trace only once the farm is over, out of the hot path
+    auto prefix = program.get<std::string>("-t");
+    tracer.print_summary();
+    if (!tracer.write_chrome_trace(prefix + ".json") || !tracer.write_csv(prefix + ".csv")) {
+        std::fprintf(stderr, "Cannot write the trace files: %s.{json,csv}\n", prefix.c_str());
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
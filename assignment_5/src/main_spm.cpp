@@ -0,0 +1,126 @@
+#include <spmutility.hpp>
+#include <assignmentconfig.h>
+#include <argparse/argparse.hpp>
+#include <skeletons.hpp>
+#include <workload.hpp>
+
+#include <latch>
+
+/***
+ * The farm of main.cpp built on spm::farm instead of OpenMP tasks: the source
+ * emits a task every ta and each worker spends ts on it.
+ */
+int main(int argc, char** argv) {
+
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    program.add_argument("-nw", "--parallel-degree")
+        .help("Parallel degree of the farm")
+        .default_value(static_cast<int>(std::thread::hardware_concurrency()))
+        .scan<'i', int>();
+
+    program.add_argument("-n", "--tasks")
+        .help("Number of tasks emitted")
+        .default_value(16)
+        .scan<'i', int>();
+
+    program.add_argument("-ta", "--inter-arrival")
+        .help("Inter-arrival time of the tasks (msecs)")
+        .default_value(250)
+        .scan<'i', int>();
+
+    program.add_argument("-ts", "--service-time")
+        .help("Service time of each task (msecs)")
+        .default_value(10'000)
+        .scan<'i', int>();
+
+    program.add_argument("-k", "--kernel")
+        .help("Work of the tasks: compute, stream, chase (pointer chasing) or mixed")
+        .default_value(std::string{"compute"});
+
+    program.add_argument("--working-set")
+        .help("Working set of each worker for the memory bound kernels (KiB)")
+        .default_value(1024)
+        .scan<'i', int>();
+
+    program.add_argument("-d", "--dispatch")
+        .help("Farm dispatching policy: on_demand or round_robin")
+        .default_value(std::string{"on_demand"});
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
+
+    auto nw = program.get<int>("-nw");
+    auto tasks = program.get<int>("-n");
+    auto ta = std::chrono::milliseconds(program.get<int>("-ta"));
+    auto ts = std::chrono::milliseconds(program.get<int>("-ts"));
+    auto dispatch_name = program.get<std::string>("-d");
+
+    if (nw <= 0 || tasks < 0 || ta.count() < 0 || ts.count() < 0) {
+        std::fprintf(stderr, "The farm parameters cannot be less than zero!\n");
+        return EXIT_FAILURE;
+    }
+    if (dispatch_name != "on_demand" && dispatch_name != "round_robin") {
+        std::fprintf(stderr, "Unknown dispatching policy: %s\n", dispatch_name.c_str());
+        return EXIT_FAILURE;
+    }
+    auto policy = (dispatch_name == "round_robin") ? spm::dispatch::round_robin
+                                                   : spm::dispatch::on_demand;
+
+    auto kind = spm::workload::parse_kind(program.get<std::string>("-k"));
+    auto working_set = program.get<int>("--working-set");
+    if (!kind || working_set <= 0) {
+        std::fprintf(stderr, "Unknown kernel %s or non positive working set\n",
+                     program.get<std::string>("-k").c_str());
+        return EXIT_FAILURE;
+    }
+    spm::workload::task_model model(*kind, static_cast<std::size_t>(working_set) * 1024);
+
+    // Calibrate and allocate the working set of each worker (it is thread
+    // local) before the first task, out of the measured time
+    std::latch prepared(nw);
+    spm::farm<int, int> farm(
+        nw,
+        [ts, &model](int task) {
+            model(ts); // Fake the computation of a task
+            return task;
+        },
+        policy);
+    farm.on_worker_start([&]() {
+        model.prepare();
+        prepared.count_down();
+    });
+
+    auto emitted = 0;
+    auto completed = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    farm.run(
+        [&]() -> std::optional<int> {
+            if (emitted == 0) {
+                prepared.wait();
+                start = std::chrono::steady_clock::now();
+            }
+            if (emitted == tasks) return std::nullopt;
+            // Wait to emit a new task (the first one is emitted right away)
+            if (emitted > 0) std::this_thread::sleep_for(ta);
+            return emitted++;
+        },
+        [&completed](int) { completed++; });
+
+    using msecs = std::chrono::duration<double, std::milli>;
+    auto measured = msecs(std::chrono::steady_clock::now() - start);
+    auto ideal = std::max(msecs(ta) * tasks, msecs(ts) * tasks / nw);
+
+    std::fprintf(stdout, "Completed %d tasks\n", completed);
+    std::fprintf(stdout, "Completion time: %.2f ms (ideal %.2f ms, efficiency %.2f)\n",
+                 measured.count(), ideal.count(),
+                 measured.count() > 0 ? ideal.count() / measured.count() : 0.0);
+
+    return EXIT_SUCCESS;
+}
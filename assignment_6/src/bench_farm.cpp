@@ -0,0 +1,220 @@
+#include <assignmentconfig.h>
+
+#include <argparse/argparse.hpp>
+#include <skeletons.hpp>
+#include <spmutility.hpp>
+#include <test_suite.hpp>
+
+#include <ff/ff.hpp>
+
+using ull = unsigned long long;
+
+static bool is_prime(ull n) {
+
+    if (n <= 3)
+        return n > 1; // 1 is not prime !
+
+    if (n % 2 == 0 || n % 3 == 0)
+        return false;
+
+    for (ull i = 5; i * i <= n; i += 6) {
+        if (n % i == 0 || n % (i + 2) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+// Benchmark: the prime farm on FastFlow (as in main_ff1.cpp) against the
+// same farm on spm::farm, counting the primes instead of printing them.
+
+struct Emitter : ff::ff_monode_t<ull> {
+
+    ull max = 2;
+    ull workers = 4;
+
+    Emitter(ull max, ull workers) : max{max}, workers{workers} {}
+
+    ull *svc(ull *_) {
+
+        int worker = 0;
+
+        for (ull i = 2; i < max; i++) {
+            ff_send_out_to(new ull(i), worker);
+            worker = (worker + 1) % this->workers;
+        }
+
+        return EOS;
+    }
+};
+
+struct IsPrimeStage : ff::ff_node_t<ull> {
+    ull *svc(ull *task) {
+        if (is_prime(*task)) {
+            return task;
+        }
+        delete task;
+        return GO_ON;
+    }
+};
+
+struct Collector : ff::ff_minode_t<ull> {
+    ull primes = 0;
+
+    ull *svc(ull *task) {
+        primes++;
+        delete task;
+        return GO_ON;
+    }
+};
+
+static ull run_fastflow(int nw, int max_num) {
+    Emitter emitter(max_num, nw);
+    Collector collector;
+
+    std::vector<std::unique_ptr<ff::ff_node>> workers;
+    for (auto i = 0; i < nw; i++) {
+        workers.push_back(std::make_unique<IsPrimeStage>());
+    }
+
+    ff::ff_Farm<IsPrimeStage> farm(std::move(workers));
+    farm.add_emitter(emitter);
+    farm.add_collector(collector);
+
+    if (farm.run_and_wait_end() < 0) {
+        ff::error("Error on processing farm.");
+    }
+
+    return collector.primes;
+}
+
+static ull run_spm(int nw, int max_num, spm::dispatch policy, bool ordered) {
+    spm::farm<ull, ull> farm(
+        nw,
+        [](ull n) -> std::optional<ull> {
+            if (is_prime(n)) return n;
+            return std::nullopt;
+        },
+        policy, ordered);
+
+    ull current = 2;
+    ull primes = 0;
+    farm.run(
+        [&current, max_num]() -> std::optional<ull> {
+            if (current < static_cast<ull>(max_num)) return current++;
+            return std::nullopt;
+        },
+        [&primes](ull) { primes++; });
+
+    return primes;
+}
+
+int main(int argc, char **argv) {
+
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    int nw = std::thread::hardware_concurrency();
+    int max_num = 1'000'000;
+
+    program.add_argument("-nw", "--parallel-degree")
+        .help("Parallel degree of the program")
+        .scan<'i', int>();
+
+    program.add_argument("-m", "--max-num")
+        .help("Maximum number in the range (i.e. [2, m]")
+        .scan<'i', int>();
+
+    program.add_argument("-r", "--repetitions")
+        .help("Timed repetitions of each farm (the minimum when adaptive)")
+        .default_value(5)
+        .scan<'i', int>();
+
+    program.add_argument("--warmup")
+        .help("Untimed runs of each farm before the timed ones")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--adaptive")
+        .help("Repeat until the 95% confidence interval is within 2% of the mean")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-o", "--output")
+        .help("Export the measures to a .csv or .json file");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
+
+    if (auto v = program.present<int>("-nw")) {
+        nw = *v;
+    }
+    if (auto v = program.present<int>("-m")) {
+        max_num = *v;
+    }
+
+    if (nw <= 0) {
+        std::fprintf(stderr, "The parallel degree must be positive!\n");
+        return EXIT_FAILURE;
+    }
+
+    spm::suite_options opts;
+    opts.iterations = program.get<int>("-r");
+    opts.warmup = program.get<int>("--warmup");
+    opts.adaptive = program.get<bool>("--adaptive");
+    if (opts.iterations < 1 || opts.warmup < 0) {
+        std::fprintf(stderr, "The repetitions must be positive and the warmup runs "
+                             "not negative!\n");
+        return EXIT_FAILURE;
+    }
+
+    spm::benchmark_report report;
+    // Measure a farm, returning the primes it found
+    auto bench = [&](const std::string &name, auto &&run) {
+        ull primes = 0;
+        report.add(name, {{"nw", std::to_string(nw)}, {"m", std::to_string(max_num)}},
+                   spm::test_suite(opts, [&]() { primes = run(); }));
+        return primes;
+    };
+
+    auto ff_primes = bench("fastflow", [&]() { return run_fastflow(nw, max_num); });
+    auto rr_primes = bench("spm_farm_round_robin", [&]() {
+        return run_spm(nw, max_num, spm::dispatch::round_robin, false);
+    });
+    auto od_primes = bench("spm_farm_on_demand", [&]() {
+        return run_spm(nw, max_num, spm::dispatch::on_demand, false);
+    });
+    auto ordered_primes = bench("spm_farm_on_demand_ordered", [&]() {
+        return run_spm(nw, max_num, spm::dispatch::on_demand, true);
+    });
+    report.print();
+
+    if (ff_primes != rr_primes || ff_primes != od_primes || ff_primes != ordered_primes) {
+        std::fprintf(stderr, "The farms found a different number of primes!\n");
+        return EXIT_FAILURE;
+    }
+
+    // Speedups of the medians, against the FastFlow farm
+    const auto &results = report.results();
+    auto ff_median = results[0].result.median;
+    std::fprintf(stdout, "Found %llu primes with %d workers\n", ff_primes, nw);
+    std::fprintf(stdout, "spm::farm (round robin) vs FastFlow: %.2f\n",
+                 spm::speedup(ff_median, results[1].result.median));
+    std::fprintf(stdout, "spm::farm (on demand) vs FastFlow: %.2f\n",
+                 spm::speedup(ff_median, results[2].result.median));
+    std::fprintf(stdout, "spm::farm (on demand, ordered) vs FastFlow: %.2f\n",
+                 spm::speedup(ff_median, results[3].result.median));
+
+    if (auto path = program.present<std::string>("-o")) {
+        if (!report.write(*path)) {
+            std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
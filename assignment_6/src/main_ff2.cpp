@@ -1,6 +1,7 @@
 #include <assignmentconfig.h>
 
 #include <argparse/argparse.hpp>
+#include <partitioner.hpp>
 #include <spmutility.hpp>
 
 #include <ff/parallel_for.hpp>
@@ -38,6 +39,15 @@ int main(int argc, char **argv) {
         .help("Maximum number in the range (i.e. [2, m]")
         .scan<'i', int>();
 
+    program.add_argument("-s", "--schedule")
+        .help("Loop schedule: static, cost, dynamic, guided or adaptive")
+        .default_value(std::string{"static"});
+
+    program.add_argument("-c", "--chunk")
+        .help("Minimum chunk size for dynamic, guided and adaptive schedules")
+        .default_value(1)
+        .scan<'i', int>();
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -53,12 +63,30 @@ int main(int argc, char **argv) {
         max_num = *v;
     }
 
+    auto policy = spm::parse_schedule(program.get<std::string>("-s"));
+    if (!policy) {
+        std::fprintf(stderr, "Unknown schedule: %s\n",
+                     program.get<std::string>("-s").c_str());
+        return EXIT_FAILURE;
+    }
+
+    // is_prime(i) performs up to sqrt(i) divisions
+    spm::loop_scheduler scheduler(
+        2, max_num, nw, *policy, [](std::size_t i) { return std::sqrt(i); },
+        program.get<int>("-c"));
+
+    // One index per worker: each index drains the scheduler, so the
+    // partitioning is decided by our scheduler and not by FastFlow's one.
     ff::ParallelFor pf;
     pf.parallel_for(
-        2, max_num,
-        [](const long idx) {
-            if (is_prime(idx)) {
-                std::cout << "The number: " << idx << " is prime.\n";
+        0, nw, 1, 1,
+        [&scheduler](const long worker) {
+            while (auto r = scheduler.next(worker)) {
+                for (ull i = r->first; i < r->second; i++) {
+                    if (is_prime(i)) {
+                        std::cout << "The number: " << i << " is prime.\n";
+                    }
+                }
             }
         },
         nw);
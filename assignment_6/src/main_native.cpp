@@ -0,0 +1,228 @@
+#include <assignmentconfig.h>
+
+#include <argparse/argparse.hpp>
+#include <autotuner.hpp>
+#include <partitioner.hpp>
+#include <reduce.hpp>
+#include <scalability.hpp>
+#include <spmutility.hpp>
+#include <test_suite.hpp>
+#include <worker_team.hpp>
+
+using ull = unsigned long long;
+
+static bool is_prime(ull n) {
+
+    if (n <= 3)
+        return n > 1; // 1 is not prime !
+
+    if (n % 2 == 0 || n % 3 == 0)
+        return false;
+
+    for (ull i = 5; i * i <= n; i += 6) {
+        if (n % i == 0 || n % (i + 2) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    int nw = std::thread::hardware_concurrency();
+    int max_num = 1'000'000;
+
+    program.add_argument("-nw", "--parallel-degree")
+        .help("Parallel degree of the program")
+        .scan<'i', int>();
+
+    program.add_argument("-m", "--max-num")
+        .help("Maximum number in the range (i.e. [2, m]")
+        .scan<'i', int>();
+
+    program.add_argument("-s", "--schedule")
+        .help("Loop schedule: static, cost, dynamic, guided or adaptive")
+        .default_value(std::string{"static"});
+
+    program.add_argument("-c", "--chunk")
+        .help("Minimum chunk size for dynamic, guided and adaptive schedules")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("-r", "--repetitions")
+        .help("Timed repetitions (the minimum when adaptive)")
+        .default_value(5)
+        .scan<'i', int>();
+
+    program.add_argument("--warmup")
+        .help("Untimed runs before the timed ones")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--adaptive")
+        .help("Repeat until the 95% confidence interval is within 2% of the mean")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--sweep")
+        .help("Scalability sweep for nw = 1, ..., the given value (ignores -nw)")
+        .scan<'i', int>();
+
+    program.add_argument("--scaling")
+        .help("Sweep with fixed range (strong), range growing with nw (weak) or both")
+        .default_value(std::string{"both"});
+
+    program.add_argument("--tune")
+        .help("Use the tuned parallel degree and chunk of this range and schedule, sampling "
+              "them the first time (overrides -nw and -c)")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-o", "--output")
+        .help("Export the measures to a .csv or .json file (.csv only with --sweep)");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
+
+    if (auto v = program.present<int>("-nw")) {
+        nw = *v;
+    }
+    if (auto v = program.present<int>("-m")) {
+        max_num = *v;
+    }
+
+    auto policy = spm::parse_schedule(program.get<std::string>("-s"));
+    if (!policy) {
+        std::fprintf(stderr, "Unknown schedule: %s\n",
+                     program.get<std::string>("-s").c_str());
+        return EXIT_FAILURE;
+    }
+
+    spm::suite_options opts;
+    opts.iterations = program.get<int>("-r");
+    opts.warmup = program.get<int>("--warmup");
+    opts.adaptive = program.get<bool>("--adaptive");
+    if (opts.iterations < 1 || opts.warmup < 0) {
+        std::fprintf(stderr, "The repetitions must be positive and the warmup runs "
+                             "not negative!\n");
+        return EXIT_FAILURE;
+    }
+
+    ull total = 0;
+    auto chunk = program.get<int>("-c");
+
+    auto count_primes = [&](ull max, spm::worker_team &team) {
+        // A static partition is a plain map-reduce
+        if (*policy == spm::schedule::block) {
+            total = spm::map_reduce(team, 2, max, 0ULL,
+                                    [](std::size_t i) -> ull { return is_prime(i) ? 1 : 0; });
+            return;
+        }
+
+        // is_prime(i) performs up to sqrt(i) divisions
+        spm::loop_scheduler scheduler(
+            2, max, team.size(), *policy, [](std::size_t i) { return std::sqrt(i); }, chunk);
+        std::vector<spm::padded<ull>> primes(team.size(), spm::padded<ull>{0});
+
+        team.run([&](std::size_t id) {
+            ull found = 0;
+            while (auto r = scheduler.next(id)) {
+                for (ull i = r->first; i < r->second; i++) {
+                    if (is_prime(i)) found++;
+                }
+            }
+            primes[id].value = found;
+        });
+
+        total = 0;
+        for (const auto &p : primes) total += p.value;
+    };
+
+    if (auto max_nw = program.present<int>("--sweep")) {
+        auto sweep = spm::parse_scaling(program.get<std::string>("--scaling"));
+        if (!sweep || *max_nw < 1) {
+            std::fprintf(stderr, "Invalid sweep: --sweep must be positive and --scaling "
+                                 "one of strong, weak or both\n");
+            return EXIT_FAILURE;
+        }
+        sweep->max_nw = *max_nw;
+        sweep->size = static_cast<std::size_t>(max_num);
+
+        auto measure = [&](std::size_t max, int workers) {
+            if (workers > 0) {
+                // The team is started out of the measured time
+                spm::worker_team team(static_cast<std::size_t>(workers));
+                return spm::test_suite(opts, [&]() { count_primes(max, team); });
+            }
+            return spm::test_suite(opts, [&]() {
+                total = 0;
+                for (ull i = 2; i < max; i++) {
+                    if (is_prime(i)) total++;
+                }
+            });
+        };
+
+        auto report = spm::scalability_sweep("primes_native", *sweep, measure);
+        report.print();
+
+        if (auto path = program.present<std::string>("-o")) {
+            if (!report.write_csv(*path)) {
+                std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (program.get<bool>("--tune")) {
+        // The teams are created by the untimed warmup run of each candidate
+        std::map<int, std::unique_ptr<spm::worker_team>> teams;
+        auto run = [&](int workers, std::size_t grain) {
+            auto &team = teams[workers];
+            if (!team) team = std::make_unique<spm::worker_team>(workers);
+            chunk = static_cast<int>(grain);
+            count_primes(max_num, *team);
+        };
+
+        // The chunk matters only to the dynamic schedules
+        std::vector<std::size_t> grains = {1, 16, 256, 4096};
+        if (*policy == spm::schedule::block || *policy == spm::schedule::cost) grains = {1};
+
+        spm::autotuner tuner;
+        auto kernel = "primes_native/" + program.get<std::string>("-s");
+        auto cached = tuner.lookup(kernel, max_num).has_value();
+        auto tuned = tuner.tune(kernel, max_num, run, spm::autotuner::default_degrees(), grains);
+
+        nw = tuned.nw;
+        chunk = static_cast<int>(tuned.grain);
+        std::fprintf(stdout, "Tuned configuration (%s): nw=%d chunk=%d\n",
+                     cached ? "from the profile" : "sampled", nw, chunk);
+    }
+
+    spm::worker_team team(static_cast<std::size_t>(nw));
+    spm::benchmark_report report;
+    report.add("primes_native",
+               {{"m", std::to_string(max_num)}, {"nw", std::to_string(nw)},
+                {"schedule", program.get<std::string>("-s")}, {"chunk", std::to_string(chunk)}},
+               spm::test_suite(opts, [&]() { count_primes(max_num, team); }));
+    report.print();
+
+    std::cout << "Found " << total << " prime numbers, in "
+              << report.results().back().result.median / 1e6 << " seconds (median)\n";
+
+    if (auto path = program.present<std::string>("-o")) {
+        if (!report.write(*path)) {
+            std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
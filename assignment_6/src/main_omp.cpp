@@ -1,7 +1,10 @@
 #include <assignmentconfig.h>
 
 #include <argparse/argparse.hpp>
+#include <partitioner.hpp>
+#include <prime_count.hpp>
 #include <spmutility.hpp>
+#include <test_suite.hpp>
 
 #include <omp.h>
 
@@ -28,7 +31,7 @@ int main(int argc, char **argv) {
     argparse::ArgumentParser program(Assignment_PROJECT_NAME);
 
     int nw = std::thread::hardware_concurrency();
-    int max_num = 1'000'000;
+    ull max_num = 1'000'000;
 
     program.add_argument("-nw", "--parallel-degree")
         .help("Parallel degree of the program")
@@ -36,8 +39,44 @@ int main(int argc, char **argv) {
 
     program.add_argument("-m", "--max-num")
         .help("Maximum number in the range (i.e. [2, m]")
+        .scan<'i', long long>();
+
+    program.add_argument("-e", "--engine")
+        .help("brute (primality test of each number) or lucy (count only, Lucy_Hedgehog)")
+        .default_value(std::string{"brute"});
+
+    program.add_argument("--check")
+        .help("Compare the count of the lucy engine with the brute force one")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-s", "--schedule")
+        .help("Loop schedule: static, cost, dynamic, guided or adaptive")
+        .default_value(std::string{"static"});
+
+    program.add_argument("-c", "--chunk")
+        .help("Minimum chunk size for dynamic, guided and adaptive schedules")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("-r", "--repetitions")
+        .help("Timed repetitions (the minimum when adaptive)")
+        .default_value(5)
         .scan<'i', int>();
 
+    program.add_argument("--warmup")
+        .help("Untimed runs before the timed ones")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--adaptive")
+        .help("Repeat until the 95% confidence interval is within 2% of the mean")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-o", "--output")
+        .help("Export the measures to a .csv or .json file");
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -49,22 +88,91 @@ int main(int argc, char **argv) {
     if (auto v = program.present<int>("-nw")) {
         nw = *v;
     }
-    if (auto v = program.present<int>("-m")) {
-        max_num = *v;
+    if (auto v = program.present<long long>("-m")) {
+        if (*v < 0) {
+            std::fprintf(stderr, "The maximum number cannot be negative!\n");
+            return EXIT_FAILURE;
+        }
+        max_num = static_cast<ull>(*v);
     }
 
-    int primes = 0;
+    auto engine = program.get<std::string>("-e");
+    if (engine != "brute" && engine != "lucy") {
+        std::fprintf(stderr, "Unknown engine: %s\n", engine.c_str());
+        return EXIT_FAILURE;
+    }
+
+    auto policy = spm::parse_schedule(program.get<std::string>("-s"));
+    if (!policy) {
+        std::fprintf(stderr, "Unknown schedule: %s\n",
+                     program.get<std::string>("-s").c_str());
+        return EXIT_FAILURE;
+    }
 
-    double start = omp_get_wtime();
-    #pragma omp parallel for reduction(+:primes) num_threads(nw)
-    for (ull i = 2; i < max_num; i++) {
-        if (is_prime(i)) {
-            primes++;
+    spm::suite_options opts;
+    opts.iterations = program.get<int>("-r");
+    opts.warmup = program.get<int>("--warmup");
+    opts.adaptive = program.get<bool>("--adaptive");
+    if (opts.iterations < 1 || opts.warmup < 0) {
+        std::fprintf(stderr, "The repetitions must be positive and the warmup runs "
+                             "not negative!\n");
+        return EXIT_FAILURE;
+    }
+
+    ull primes = 0;
+
+    auto count_primes = [&]() {
+        primes = 0;
+        // is_prime(i) performs up to sqrt(i) divisions
+        spm::loop_scheduler scheduler(
+            2, max_num + 1, nw, *policy, [](std::size_t i) { return std::sqrt(i); },
+            program.get<int>("-c"));
+
+        #pragma omp parallel reduction(+:primes) num_threads(nw)
+        {
+            // OpenMP may start fewer than nw threads (OMP_THREAD_LIMIT, dynamic
+            // adjustment): the static ranges of the missing ones are taken too
+            for (auto id = omp_get_thread_num(); id < nw; id += omp_get_num_threads()) {
+                while (auto r = scheduler.next(static_cast<std::size_t>(id))) {
+                    for (ull i = r->first; i < r->second; i++) {
+                        if (is_prime(i)) {
+                            primes++;
+                        }
+                    }
+                }
+            }
         }
+    };
+
+    spm::benchmark_report report;
+    if (engine == "lucy") {
+        report.add("primes_lucy", {{"m", std::to_string(max_num)}, {"nw", std::to_string(nw)}},
+                   spm::test_suite(opts, [&]() { primes = spm::prime_pi(max_num, nw); }));
+    } else {
+        report.add("primes_omp",
+                   {{"m", std::to_string(max_num)}, {"nw", std::to_string(nw)},
+                    {"schedule", program.get<std::string>("-s")}},
+                   spm::test_suite(opts, count_primes));
+    }
+    report.print();
+
+    if (engine == "lucy" && program.get<bool>("--check")) {
+        auto counted = primes;
+        count_primes();
+        std::cout << "Brute force count: " << primes << " ("
+                  << (primes == counted ? "matches" : "DIFFERS") << ")\n";
+        if (primes != counted) return EXIT_FAILURE;
     }
-    double elapsed = omp_get_wtime() - start;
 
-    std::cout << "Found " << primes << " prime numbers, in " << elapsed << " seconds\n";
+    std::cout << "Found " << primes << " prime numbers, in "
+              << report.results().back().result.median / 1e6 << " seconds (median)\n";
+
+    if (auto path = program.present<std::string>("-o")) {
+        if (!report.write(*path)) {
+            std::fprintf(stderr, "Cannot write the measures to %s\n", path->c_str());
+            return EXIT_FAILURE;
+        }
+    }
 
     return EXIT_SUCCESS;
 };
\ No newline at end of file
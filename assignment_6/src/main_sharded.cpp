@@ -0,0 +1,327 @@
+#include <assignmentconfig.h>
+
+#include <argparse/argparse.hpp>
+#include <shared_memory.hpp>
+#include <spmutility.hpp>
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <csignal>
+#include <cstring>
+
+using u64 = std::uint64_t;
+
+/// Primality test of the assignment, safe for the whole 64 bit range.
+static bool is_prime(u64 n) {
+
+    if (n <= 3)
+        return n > 1; // 1 is not prime !
+
+    if (n % 2 == 0 || n % 3 == 0)
+        return false;
+
+    for (u64 i = 5; i <= n / i; i += 6) {
+        if (n % i == 0 || n % (i + 2) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+__extension__ typedef unsigned __int128 u128;
+
+static u64 mul_mod(u64 a, u64 b, u64 m) { return static_cast<u64>(static_cast<u128>(a) * b % m); }
+
+static u64 pow_mod(u64 base, u64 exp, u64 m) {
+    u64 result = 1;
+    for (base %= m; exp > 0; exp >>= 1, base = mul_mod(base, base, m))
+        if (exp & 1) result = mul_mod(result, base, m);
+    return result;
+}
+
+/***
+ * Deterministic Miller-Rabin: the first 12 primes as bases are enough for
+ * any n < 2^64, in O(log n) products instead of the O(sqrt(n)) divisions
+ * of is_prime (about 10^9 for a prime close to 2^63).
+ */
+static bool is_prime_mr(u64 n) {
+    constexpr std::array<u64, 12> bases{2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    if (n < 2) return false;
+    for (auto p : bases) {
+        if (n % p == 0) return n == p;
+    }
+
+    // n - 1 = d * 2^r with d odd
+    auto d = n - 1;
+    auto r = 0;
+    for (; d % 2 == 0; d /= 2) r++;
+
+    for (auto a : bases) {
+        auto x = pow_mod(a, d, n);
+        if (x == 1 || x == n - 1) continue;
+        auto composite = true;
+        for (auto i = 1; i < r && composite; i++) {
+            x = mul_mod(x, x, n);
+            composite = (x != n - 1);
+        }
+        if (composite) return false;
+    }
+    return true;
+}
+
+static u64 isqrt(u64 n) {
+    auto r = static_cast<u64>(std::sqrt(static_cast<long double>(n)));
+    while (r > 0 && r > n / r) r--;
+    while (r + 1 <= n / (r + 1)) r++;
+    return r;
+}
+
+/// Odd primes up to max, with the sieve of Eratosthenes.
+static std::vector<std::uint32_t> base_primes(u64 max) {
+    std::vector<bool> composite(max + 1);
+    std::vector<std::uint32_t> primes;
+    for (u64 i = 3; i <= max; i += 2) {
+        if (composite[i]) continue;
+        primes.push_back(static_cast<std::uint32_t>(i));
+        for (u64 j = i * i; j <= max; j += 2 * i) composite[j] = true;
+    }
+    return primes;
+}
+
+/***
+ * Number of primes in [lo, hi) with a segmented sieve of the odd numbers:
+ * windows of 256K odd numbers (one byte each) stay in the L2 cache, and
+ * base must hold the odd primes up to sqrt(hi).
+ */
+static u64 sieve_count(u64 lo, u64 hi, const std::vector<std::uint32_t> &base) {
+    constexpr u64 WINDOW = 1 << 18;
+
+    u64 count = (lo <= 2 && 2 < hi) ? 1 : 0;
+    lo = std::max<u64>(lo, 3) | 1;
+    if (lo >= hi) return count;
+
+    std::vector<std::uint8_t> composite(WINDOW);
+    for (auto first = lo; first < hi; first += 2 * WINDOW) {
+        auto last = std::min(hi, first + 2 * WINDOW);
+        auto odds = (last - first + 1) / 2;
+        std::fill_n(composite.begin(), odds, 0);
+
+        for (u64 p : base) {
+            if (p * p >= last) break;
+            // First odd multiple of p in the window, not below p^2
+            auto m = std::max(p * p, (first + p - 1) / p * p);
+            if (m % 2 == 0) m += p;
+            for (; m < last; m += 2 * p) composite[(m - first) / 2] = 1;
+        }
+
+        for (u64 i = 0; i < odds; i++) count += !composite[i];
+    }
+    return count;
+}
+
+/***
+ * Table of the work units in shared memory. Units are claimed by the
+ * shard processes through the shared cursor (so faster shards take more
+ * of them), and each result goes in its own slot of the counter array,
+ * read in place by the coordinator. A unit claimed by a shard which then
+ * crashed stays claimed and is given back by the coordinator.
+ */
+struct unit_table {
+    enum : std::uint32_t { FREE, CLAIMED, DONE };
+
+    static_assert(std::atomic<u64>::is_always_lock_free, "atomics must be address free");
+
+    std::atomic<u64> *next;
+    std::atomic<std::uint32_t> *state;
+    std::atomic<u64> *counts;
+    u64 units;
+
+    static std::size_t bytes(u64 units) {
+        return 64 + (units * sizeof(std::uint32_t) + 7) / 8 * 8 + units * sizeof(u64);
+    }
+
+    unit_table(const spm::shared_region &region, u64 units)
+        : next(region.as<std::atomic<u64>>()),
+          state(region.as<std::atomic<std::uint32_t>>(64)),
+          counts(region.as<std::atomic<u64>>(64 + (units * sizeof(std::uint32_t) + 7) / 8 * 8)),
+          units(units) {}
+};
+
+int main(int argc, char **argv) {
+
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    program.add_argument("-f", "--from")
+        .help("Minimum number in the range (i.e. [f, m])")
+        .default_value(2LL)
+        .scan<'i', long long>();
+
+    program.add_argument("-m", "--max-num")
+        .help("Maximum number in the range (i.e. [f, m]), up to 2^63 - 1 (the sieve needs "
+              "the primes up to sqrt(m), so narrower ranges are tested with Miller-Rabin)")
+        .default_value(1'000'000LL)
+        .scan<'i', long long>();
+
+    program.add_argument("-p", "--processes")
+        .help("Shard processes forked by the coordinator")
+        .default_value(static_cast<int>(std::thread::hardware_concurrency()))
+        .scan<'i', int>();
+
+    program.add_argument("--method")
+        .help("How the shards find the primes: sieve (segmented) or test (primality test)")
+        .default_value(std::string{"sieve"});
+
+    program.add_argument("--unit")
+        .help("Numbers in a work unit (0 chooses 64 units per shard, at least 2^20 numbers each)")
+        .default_value(0LL)
+        .scan<'i', long long>();
+
+    program.add_argument("--retries")
+        .help("Rounds of new shards for the units of the crashed ones")
+        .default_value(2)
+        .scan<'i', int>();
+
+    program.add_argument("--fail-shard")
+        .help("Kill this shard after its first unit, to try the recovery")
+        .scan<'i', int>();
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
+
+    auto from = program.get<long long>("-f");
+    auto max_num = program.get<long long>("-m");
+    auto processes = program.get<int>("-p");
+    auto method = program.get<std::string>("--method");
+    auto unit = program.get<long long>("--unit");
+
+    if (from < 0 || max_num < from || processes < 1 || unit < 0) {
+        std::fprintf(stderr, "The range must be 0 <= f <= m, the processes positive and the "
+                             "unit not negative!\n");
+        return EXIT_FAILURE;
+    }
+    if (method != "sieve" && method != "test") {
+        std::fprintf(stderr, "Unknown method: %s\n", method.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // The range as [lo, hi): hi fits since m < 2^63
+    u64 lo = static_cast<u64>(from), hi = static_cast<u64>(max_num) + 1;
+    if (unit == 0) {
+        unit = static_cast<long long>(std::max<u64>((hi - lo) / (64 * processes), 1 << 20));
+    }
+    u64 units = (hi - lo + unit - 1) / unit;
+
+    // The sieve needs the primes up to sqrt(hi) whatever the width of the
+    // range: up to 3 * 10^9 numbers (seconds and a GB) close to 2^63. When
+    // the range is narrower than that, test each number with Miller-Rabin
+    if (method == "sieve" && hi - lo < isqrt(hi)) {
+        std::fprintf(stderr, "The range is narrower than sqrt(m): testing with Miller-Rabin "
+                             "instead of sieving\n");
+        method = "miller_rabin";
+    }
+
+    spm::utimer timer("sharded primes");
+
+    // Computed once: the shards inherit them with fork
+    std::vector<std::uint32_t> base;
+    if (method == "sieve") base = base_primes(isqrt(hi));
+
+    spm::shared_region region("/spm_primes_" + std::to_string(getpid()), unit_table::bytes(units));
+    if (!region.ok()) {
+        std::fprintf(stderr, "Cannot create the shared memory %s: %s\n", region.path().c_str(),
+                     std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Nobody else attaches: the shards inherit the mapping
+    region.unlink();
+    unit_table table(region, units);
+
+    auto fail_shard = program.present<int>("--fail-shard");
+    bool first_round = true;
+
+    auto shard = [&](std::size_t id) -> int {
+        u64 done = 0;
+        while (true) {
+            auto u = table.next->fetch_add(1, std::memory_order_relaxed);
+            if (u >= units) return 0;
+
+            std::uint32_t expected = unit_table::FREE;
+            if (!table.state[u].compare_exchange_strong(expected, unit_table::CLAIMED)) continue;
+
+            if (first_round && fail_shard && static_cast<std::size_t>(*fail_shard) == id &&
+                done == 1) {
+                std::raise(SIGKILL);
+            }
+
+            auto first = lo + u * static_cast<u64>(unit);
+            auto last = std::min(hi, first + static_cast<u64>(unit));
+            u64 count = 0;
+            if (method == "sieve") {
+                count = sieve_count(first, last, base);
+            } else if (method == "miller_rabin") {
+                for (auto i = first; i < last; i++) count += is_prime_mr(i);
+            } else {
+                for (auto i = first; i < last; i++) count += is_prime(i);
+            }
+
+            table.counts[u].store(count, std::memory_order_relaxed);
+            table.state[u].store(unit_table::DONE, std::memory_order_release);
+            done++;
+        }
+    };
+
+    auto retries = std::max(program.get<int>("--retries"), 0);
+    for (int round = 0; round <= retries; round++, first_round = false) {
+        // No shard is alive: give back the units of the crashed ones
+        u64 pending = 0;
+        for (u64 u = 0; u < units; u++) {
+            if (table.state[u].load() != unit_table::DONE) {
+                table.state[u].store(unit_table::FREE);
+                pending++;
+            }
+        }
+        if (pending == 0) break;
+        table.next->store(0);
+
+        auto shards = static_cast<std::size_t>(std::min<u64>(processes, pending));
+        auto statuses = spm::run_processes(shards, shard);
+        for (std::size_t i = 0; i < statuses.size(); i++) {
+            const auto &s = statuses[i];
+            if (s.ok()) continue;
+            if (s.signal != 0) {
+                std::fprintf(stderr, "Shard %zu (pid %d) killed by signal %d\n", i, s.pid, s.signal);
+            } else {
+                std::fprintf(stderr, "Shard %zu (pid %d) failed with exit code %d\n", i, s.pid,
+                             s.exit_code);
+            }
+        }
+    }
+
+    // The counters are read in place, no copy from the shards
+    u64 total = 0, missing = 0;
+    for (u64 u = 0; u < units; u++) {
+        if (table.state[u].load(std::memory_order_acquire) == unit_table::DONE) {
+            total += table.counts[u].load(std::memory_order_relaxed);
+        } else {
+            missing++;
+        }
+    }
+    if (missing > 0) {
+        std::fprintf(stderr, "%llu of %llu units were not completed\n",
+                     static_cast<unsigned long long>(missing),
+                     static_cast<unsigned long long>(units));
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Found " << total << " prime numbers in [" << lo << ", " << hi - 1 << "] ("
+              << units << " units of " << unit << " numbers, " << processes << " shards)\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#include <assignmentconfig.h>
+
+#include <argparse/argparse.hpp>
+#include <skeletons.hpp>
+#include <spmutility.hpp>
+
+using ull = unsigned long long;
+
+static bool is_prime(ull n) {
+
+    if (n <= 3)
+        return n > 1; // 1 is not prime !
+
+    if (n % 2 == 0 || n % 3 == 0)
+        return false;
+
+    for (ull i = 5; i * i <= n; i += 6) {
+        if (n % i == 0 || n % (i + 2) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+// spm structure: the same farm of main_ff1.cpp, built on our own runtime.
+
+int main(int argc, char **argv) {
+
+    argparse::ArgumentParser program(Assignment_PROJECT_NAME);
+
+    int nw = std::thread::hardware_concurrency();
+    int max_num = 1'000'000;
+
+    program.add_argument("-nw", "--parallel-degree")
+        .help("Parallel degree of the program")
+        .scan<'i', int>();
+
+    program.add_argument("-m", "--max-num")
+        .help("Maximum number in the range (i.e. [2, m]")
+        .scan<'i', int>();
+
+    program.add_argument("-d", "--dispatch")
+        .help("Farm dispatching policy: on_demand or round_robin")
+        .default_value(std::string{"round_robin"});
+
+    program.add_argument("-o", "--ordered")
+        .help("Print the primes in increasing order")
+        .default_value(false)
+        .implicit_value(true);
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::fprintf(stderr, "Got an exception during parsing: %s\n",
+                     err.what());
+        return EXIT_FAILURE;
+    }
+
+    if (auto v = program.present<int>("-nw")) {
+        nw = *v;
+    }
+    if (auto v = program.present<int>("-m")) {
+        max_num = *v;
+    }
+
+    auto dispatch_name = program.get<std::string>("-d");
+
+    if (nw <= 0) {
+        std::fprintf(stderr, "The parallel degree must be positive!\n");
+        return EXIT_FAILURE;
+    }
+    if (dispatch_name != "on_demand" && dispatch_name != "round_robin") {
+        std::fprintf(stderr, "Unknown dispatching policy: %s\n", dispatch_name.c_str());
+        return EXIT_FAILURE;
+    }
+    auto policy = (dispatch_name == "on_demand") ? spm::dispatch::on_demand
+                                                 : spm::dispatch::round_robin;
+
+    spm::farm<ull, ull> farm(
+        nw,
+        [](ull n) -> std::optional<ull> {
+            // If the number is not prime, drop it
+            if (is_prime(n)) return n;
+            return std::nullopt;
+        },
+        policy, program.get<bool>("-o"));
+
+    ull current = 2;
+    farm.run(
+        [&current, max_num]() -> std::optional<ull> {
+            if (current < static_cast<ull>(max_num)) return current++;
+            return std::nullopt;
+        },
+        [](ull prime) {
+            std::cout << "The number: " << prime << " is prime.\n";
+        });
+
+    return EXIT_SUCCESS;
+}
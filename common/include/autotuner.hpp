@@ -0,0 +1,149 @@
+#ifndef SPM_AUTOTUNER_H
+#define SPM_AUTOTUNER_H
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "test_suite.hpp"
+
+namespace spm {
+
+/// Configuration chosen for a kernel: parallel degree and grain (chunk) size.
+struct tuning {
+    int nw = 1;
+    std::size_t grain = 0;
+    /// Median time of the configuration when it was sampled (μs)
+    double time_us = 0;
+};
+
+/***
+ * Picks the fastest (nw, grain) of a kernel by briefly timing the candidate
+ * configurations, and remembers the choice in a profile file keyed by host,
+ * kernel and input size (rounded to the power of two), so later runs get it
+ * without sampling. The profile is a text file, one configuration per line:
+ *
+ *     <host> <kernel> <log2 size> <nw> <grain> <time μs>
+ *
+ * Its path is $SPM_TUNING_PROFILE, or .spm_tuning in the working directory.
+ */
+class autotuner {
+    using key = std::tuple<std::string, std::string, int>;
+
+    std::string path;
+    std::string host;
+    std::map<key, tuning> entries;
+
+    static int size_class(std::size_t size) noexcept {
+        return static_cast<int>(std::bit_width(size));
+    }
+
+    void load() {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string h, kernel;
+            int size = 0;
+            tuning t;
+            if (fields >> h >> kernel >> size >> t.nw >> t.grain >> t.time_us) {
+                entries[{h, kernel, size}] = t;
+            }
+        }
+    }
+
+   public:
+    explicit autotuner(std::string profile_path = default_path()) : path(std::move(profile_path)) {
+        char name[256] = "localhost";
+        if (gethostname(name, sizeof(name)) != 0) name[0] = '\0';
+        name[sizeof(name) - 1] = '\0';
+        host = name;
+        load();
+    }
+
+    static std::string default_path() {
+        if (const char *env = std::getenv("SPM_TUNING_PROFILE")) return env;
+        return ".spm_tuning";
+    }
+
+    /// Parallel degrees worth trying: powers of two up to the hardware threads, and those.
+    static std::vector<int> default_degrees() {
+        auto hw = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<int> degrees;
+        for (int nw = 1; nw < hw; nw *= 2) degrees.push_back(nw);
+        degrees.push_back(hw);
+        return degrees;
+    }
+
+    /// Tuned configuration of kernel on an input of the given size, if any.
+    std::optional<tuning> lookup(const std::string &kernel, std::size_t size) const {
+        auto it = entries.find({host, kernel, size_class(size)});
+        if (it == entries.end()) return std::nullopt;
+        return it->second;
+    }
+
+    /***
+     * Return the tuned configuration, sampling the candidates when the profile
+     * has none: run(nw, grain) executes the kernel once and each candidate is
+     * timed with a short test_suite. The choice is saved in the profile.
+     * Kernel names must not contain spaces.
+     */
+    template <typename Run>
+    tuning tune(const std::string &kernel, std::size_t size, Run &&run,
+                const std::vector<int> &degrees = default_degrees(),
+                const std::vector<std::size_t> &grains = {0}, int iterations = 3) {
+        if (auto cached = lookup(kernel, size)) return *cached;
+
+        suite_options opts;
+        opts.warmup = 1;
+        opts.iterations = iterations;
+
+        std::optional<tuning> best;
+        for (auto nw : degrees) {
+            for (auto grain : grains) {
+                auto time = test_suite(opts, [&]() { run(nw, grain); }).median;
+                if (!best || time < best->time_us) best = tuning{nw, grain, time};
+            }
+        }
+
+        auto chosen = best.value_or(tuning{});
+        entries[{host, kernel, size_class(size)}] = chosen;
+        save();
+        return chosen;
+    }
+
+    /// Write the profile, keeping the entries added meanwhile by other processes.
+    bool save() {
+        auto ours = entries;
+        entries.clear();
+        load();
+        for (const auto &[k, t] : ours) entries[k] = t;
+
+        // Write a new file and rename it: readers never see a partial profile
+        auto tmp = path + ".tmp" + std::to_string(getpid());
+        auto *file = std::fopen(tmp.c_str(), "w");
+        if (file == nullptr) return false;
+        for (const auto &[k, t] : entries) {
+            const auto &[h, kernel, size] = k;
+            std::fprintf(file, "%s %s %d %d %zu %.3f\n", h.c_str(), kernel.c_str(), size, t.nw,
+                         t.grain, t.time_us);
+        }
+        if (std::fclose(file) != 0) return false;
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+};
+
+}  // namespace spm
+
+#endif
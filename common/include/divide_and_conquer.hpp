@@ -0,0 +1,225 @@
+#ifndef SPM_DIVIDE_AND_CONQUER_H
+#define SPM_DIVIDE_AND_CONQUER_H
+
+#include <time.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "threadpool.hpp"
+
+namespace spm {
+
+/***
+ * Learned cutoff of a divide and conquer: the cost of solving a subproblem
+ * sequentially is measured at each depth of the recursion (a moving average)
+ * and the subproblems estimated to cost less than min_task are not forked
+ * anymore. The depths without measures are estimated from the deepest one
+ * below, multiplied by the fan-out of the splits, so the cost of the leaves
+ * is enough. This assumes that the subproblems at the same depth cost about
+ * the same (balanced splits). Costs are CPU time of the solving thread: a
+ * preempted task does not look expensive, which would keep its depth forked
+ * for good. Keep the object across calls of the same problem to reuse the
+ * measures from the start.
+ */
+class dc_cutoff {
+    static constexpr std::size_t MAX_DEPTH = 64;
+
+    std::uint64_t min_task_ns;
+    /// Average cost at each depth (ns), 0 while unknown
+    std::array<std::atomic<std::uint64_t>, MAX_DEPTH> cost_ns{};
+    std::atomic<std::uint64_t> fanout{2};
+
+   public:
+    /// min_task should be well above the cost of a task of the threadpool (a few μs).
+    explicit dc_cutoff(std::chrono::microseconds min_task = std::chrono::microseconds{50})
+        : min_task_ns(static_cast<std::uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(min_task).count())) {}
+
+    void record(std::size_t depth, std::uint64_t ns) noexcept {
+        if (depth >= MAX_DEPTH) return;
+        auto old = cost_ns[depth].load(std::memory_order_relaxed);
+        cost_ns[depth].store(old ? (3 * old + ns) / 4 : std::max<std::uint64_t>(ns, 1),
+                             std::memory_order_relaxed);
+    }
+
+    void record_fanout(std::size_t children) noexcept {
+        fanout.store(std::max<std::size_t>(children, 1), std::memory_order_relaxed);
+    }
+
+    /// Estimated sequential cost of a subproblem at the given depth (ns).
+    std::optional<std::uint64_t> estimate(std::size_t depth) const noexcept {
+        auto scale = fanout.load(std::memory_order_relaxed);
+        std::uint64_t factor = 1;
+        for (auto d = depth; d < MAX_DEPTH; d++, factor *= scale) {
+            if (auto cost = cost_ns[d].load(std::memory_order_relaxed)) return cost * factor;
+            // Far from the known depth the estimate is meaningless anyway
+            if (factor > min_task_ns) return std::nullopt;
+        }
+        return std::nullopt;
+    }
+
+    /// Whether a subproblem at the given depth should be solved without forking.
+    bool sequential(std::size_t depth) const noexcept {
+        auto cost = estimate(depth);
+        return cost && *cost < min_task_ns;
+    }
+};
+
+namespace detail {
+
+/// CPU time consumed by the calling thread (ns).
+inline std::uint64_t thread_cpu_ns() noexcept {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000ULL +
+           static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+/// Continuation of a split: the last child to finish merges the results
+/// and hands them to its parent, so no worker waits for its children.
+template <typename Result>
+struct dc_join {
+    std::vector<std::optional<Result>> results;
+    std::atomic<std::size_t> pending;
+    std::shared_ptr<dc_join> parent;
+    std::size_t slot;
+
+    dc_join(std::size_t children, std::shared_ptr<dc_join> parent, std::size_t slot)
+        : results(children), pending(children), parent(std::move(parent)), slot(slot) {}
+};
+
+template <typename Problem, typename Result, typename IsBase, typename SolveBase, typename Split,
+          typename Merge>
+struct dc_context : std::enable_shared_from_this<
+                        dc_context<Problem, Result, IsBase, SolveBase, Split, Merge>> {
+    using join = dc_join<Result>;
+
+    threadpool &pool;
+    IsBase is_base;
+    SolveBase solve_base;
+    Split split;
+    Merge merge;
+    dc_cutoff &cutoff;
+    std::shared_ptr<spm::future<Result>> done = std::make_shared<spm::future<Result>>();
+
+    dc_context(threadpool &pool, IsBase is_base, SolveBase solve_base, Split split, Merge merge,
+               dc_cutoff &cutoff)
+        : pool(pool),
+          is_base(std::move(is_base)),
+          solve_base(std::move(solve_base)),
+          split(std::move(split)),
+          merge(std::move(merge)),
+          cutoff(cutoff) {}
+
+    Result solve_sequential(Problem problem) {
+        if (is_base(problem)) return solve_base(std::move(problem));
+
+        auto children = split(std::move(problem));
+        std::vector<Result> results;
+        results.reserve(children.size());
+        for (auto &child : children) results.push_back(solve_sequential(std::move(child)));
+        return merge(std::move(results));
+    }
+
+    /// Store the result in its slot; the last child merges and goes up.
+    void deliver(std::shared_ptr<join> node, std::size_t slot, Result result) {
+        while (true) {
+            node->results[slot] = std::move(result);
+            if (node->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+            // The root has a single slot, holding the final result
+            if (!node->parent) {
+                done->put(std::move(*node->results[0]));
+                return;
+            }
+
+            std::vector<Result> results;
+            results.reserve(node->results.size());
+            for (auto &r : node->results) results.push_back(std::move(*r));
+            result = merge(std::move(results));
+            slot = node->slot;
+            node = node->parent;
+        }
+    }
+
+    /// Solve problem at depth as the child slot of parent: the first child
+    /// of each split goes on in this task, the others are forked.
+    void process(Problem problem, std::size_t depth, std::shared_ptr<join> parent,
+                 std::size_t slot) {
+        while (!is_base(problem) && !cutoff.sequential(depth)) {
+            auto children = split(std::move(problem));
+            cutoff.record_fanout(children.size());
+
+            auto node = std::make_shared<join>(children.size(), parent, slot);
+            for (std::size_t i = 1; i < children.size(); i++) {
+                pool.execute([self = this->shared_from_this(), child = std::move(children[i]),
+                              depth, node, i]() mutable {
+                    self->process(std::move(child), depth + 1, node, i);
+                });
+            }
+
+            problem = std::move(children[0]);
+            parent = std::move(node);
+            slot = 0;
+            depth++;
+        }
+
+        auto start = thread_cpu_ns();
+        auto result = solve_sequential(std::move(problem));
+        cutoff.record(depth, thread_cpu_ns() - start);
+        deliver(std::move(parent), slot, std::move(result));
+    }
+};
+
+}  // namespace detail
+
+/***
+ * Divide and conquer skeleton on the threadpool: problems that are not
+ * is_base are split in subproblems (split returns a non empty vector),
+ * solved recursively, and their results combined by merge (which gets
+ * them in the order of split); base problems are solved by solve_base.
+ * Subproblems are forked as tasks and joined by continuations: the last
+ * subproblem to finish merges the results of its siblings, so workers
+ * never block waiting for each other. Subproblems cheaper than the cutoff
+ * are solved sequentially in a single task.
+ * The calling thread waits for the result, so it must not be a worker of
+ * the pool.
+ */
+template <typename Problem, typename IsBase, typename SolveBase, typename Split, typename Merge>
+auto divide_and_conquer(threadpool &pool, Problem problem, IsBase is_base, SolveBase solve_base,
+                        Split split, Merge merge, dc_cutoff &cutoff) {
+    using Result = std::decay_t<std::invoke_result_t<SolveBase &, Problem>>;
+    using context = detail::dc_context<Problem, Result, IsBase, SolveBase, Split, Merge>;
+
+    auto ctx = std::make_shared<context>(pool, std::move(is_base), std::move(solve_base),
+                                         std::move(split), std::move(merge), cutoff);
+    auto done = ctx->done;
+    auto root = std::make_shared<detail::dc_join<Result>>(1, nullptr, 0);
+
+    pool.execute([ctx, root, problem = std::move(problem)]() mutable {
+        ctx->process(std::move(problem), 0, root, 0);
+    });
+
+    return Result(std::move(done->get()));
+}
+
+/// Divide and conquer learning the cutoff from scratch.
+template <typename Problem, typename IsBase, typename SolveBase, typename Split, typename Merge>
+auto divide_and_conquer(threadpool &pool, Problem problem, IsBase is_base, SolveBase solve_base,
+                        Split split, Merge merge) {
+    dc_cutoff cutoff;
+    return divide_and_conquer(pool, std::move(problem), std::move(is_base), std::move(solve_base),
+                              std::move(split), std::move(merge), cutoff);
+}
+
+}  // namespace spm
+
+#endif
@@ -0,0 +1,422 @@
+#ifndef SPM_EXTERNAL_SORT_H
+#define SPM_EXTERNAL_SORT_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "partitioner.hpp"
+#include "worker_team.hpp"
+
+namespace spm {
+
+/***
+ * Tournament tree of k sorted sources keeping the loser of each match in
+ * the internal nodes: replacing the winner replays only the matches on its
+ * path to the root, log2(k) comparisons against a heap's 2 log2(k). Ties
+ * go to the lower source, so merging runs of a stable sort stays stable.
+ */
+template <typename T, typename Compare = std::less<T>>
+class loser_tree {
+    static constexpr std::size_t NONE = static_cast<std::size_t>(-1);
+
+    std::size_t k;
+    /// losers[0] is the overall winner, losers[1, k) the internal nodes
+    std::vector<std::size_t> losers;
+    std::vector<std::optional<T>> heads;
+    Compare less;
+
+    /// Whether source a wins against source b (exhausted sources always lose).
+    bool beats(std::size_t a, std::size_t b) const {
+        if (b == NONE || !heads[b]) return a != NONE && heads[a].has_value();
+        if (a == NONE || !heads[a]) return false;
+        if (less(*heads[a], *heads[b])) return true;
+        if (less(*heads[b], *heads[a])) return false;
+        return a < b;
+    }
+
+   public:
+    /// Build the tree from the first element of each source (nullopt if empty).
+    explicit loser_tree(std::vector<std::optional<T>> firsts, Compare less = {})
+        : k(firsts.size()), losers(std::max<std::size_t>(k, 1), NONE), heads(std::move(firsts)),
+          less(less) {
+        if (k == 0) return;
+
+        // Winners of the subtrees, leaves at [k, 2k) as in an implicit heap
+        std::vector<std::size_t> winners(2 * k);
+        for (std::size_t i = 0; i < k; i++) winners[k + i] = i;
+        for (auto n = k - 1; n >= 1; n--) {
+            auto l = winners[2 * n], r = winners[2 * n + 1];
+            winners[n] = beats(l, r) ? l : r;
+            losers[n] = beats(l, r) ? r : l;
+        }
+        losers[0] = (k == 1) ? 0 : winners[1];
+    }
+
+    /// Whether all the sources are exhausted.
+    bool empty() const noexcept { return k == 0 || !heads[losers[0]]; }
+
+    /// Source holding the smallest head.
+    std::size_t top() const noexcept { return losers[0]; }
+
+    const T &top_value() const { return *heads[losers[0]]; }
+
+    /// Replace the head of the winning source with its next element (nullopt
+    /// when it is exhausted) and replay its matches.
+    void replace_top(std::optional<T> next) {
+        auto winner = losers[0];
+        heads[winner] = std::move(next);
+
+        for (auto n = (winner + k) / 2; n >= 1; n /= 2) {
+            if (beats(losers[n], winner)) std::swap(losers[n], winner);
+        }
+        losers[0] = winner;
+    }
+};
+
+/// Sort v on the team: a block per member with std::sort, then the sorted
+/// blocks are merged pairwise in log2(nw) parallel rounds.
+template <typename T, typename Compare = std::less<T>>
+void parallel_sort(std::span<T> v, worker_team &team, Compare less = {}) {
+    auto nw = team.size();
+    auto blocks = block_partition(0, v.size(), nw);
+
+    team.run([&](std::size_t id) {
+        std::sort(v.begin() + blocks[id].first, v.begin() + blocks[id].second, less);
+
+        for (std::size_t width = 1; width < nw; width *= 2) {
+            team.sync();
+            if (id % (2 * width) == 0 && id + width < nw) {
+                auto last = std::min(id + 2 * width, nw) - 1;
+                std::inplace_merge(v.begin() + blocks[id].first, v.begin() + blocks[id + width].first,
+                                   v.begin() + blocks[last].second, less);
+            }
+        }
+    });
+}
+
+/// Read only mapping of a whole file.
+class mapped_file {
+    int fd = -1;
+    bool owned = false;
+    void *data = MAP_FAILED;
+    std::size_t bytes = 0;
+
+    void map() {
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) return;
+        bytes = static_cast<std::size_t>(st.st_size);
+        if (bytes > 0) data = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+   public:
+    explicit mapped_file(const std::string &path) : fd(::open(path.c_str(), O_RDONLY)), owned(true) {
+        map();
+    }
+
+    /// Map an open file, which stays owned by the caller.
+    explicit mapped_file(int fd) : fd(fd) { map(); }
+
+    ~mapped_file() {
+        if (data != MAP_FAILED) ::munmap(data, bytes);
+        if (owned && fd >= 0) ::close(fd);
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    bool ok() const noexcept { return fd >= 0 && (bytes == 0 || data != MAP_FAILED); }
+    std::size_t size() const noexcept { return bytes; }
+
+    template <typename T>
+    std::span<const T> as() const noexcept {
+        if (bytes == 0) return {};
+        return {static_cast<const T *>(data), bytes / sizeof(T)};
+    }
+
+    /// madvise on the pages covering [first, last) bytes.
+    void advise(std::size_t first, std::size_t last, int advice) const noexcept {
+        if (data == MAP_FAILED) return;
+        static const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        first -= first % page;
+        last = std::min(last, bytes);
+        if (first >= last) return;
+        ::madvise(static_cast<char *>(data) + first, last - first, advice);
+    }
+};
+
+namespace detail {
+
+/// write(2) all the bytes, retrying short writes.
+inline bool write_all(int fd, const void *data, std::size_t bytes) {
+    auto *p = static_cast<const char *>(data);
+    while (bytes > 0) {
+        auto written = ::write(fd, p, bytes);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+        bytes -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+/***
+ * Sequential reader of a sorted run inside a mapped file: it asks the
+ * kernel to read ahead the next window while the current one is merged,
+ * and drops the pages already merged, so the page cache does not grow
+ * with the input.
+ */
+template <typename T>
+class run_reader {
+    static constexpr std::size_t WINDOW = (8 << 20) / sizeof(T);
+
+    const mapped_file *file;
+    std::size_t next, last;
+    std::size_t window_begin, window_end;
+
+   public:
+    run_reader(const mapped_file &file, std::size_t first, std::size_t last)
+        : file(&file), next(first), last(last), window_begin(first), window_end(first) {}
+
+    std::optional<T> pop() {
+        if (next == last) return std::nullopt;
+
+        if (next == window_end) {
+            // Merged window out, the one after the next in. Only the pages
+            // wholly inside the window are released: the ones at its ends
+            // are shared with the rest of this run or with the run before,
+            // which other readers of the merge are still reading
+            static const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            auto begin = (window_begin * sizeof(T) + page - 1) / page * page;
+            auto end = next * sizeof(T) / page * page;
+            if (begin < end) file->advise(begin, end, MADV_DONTNEED);
+
+            window_begin = next;
+            window_end = std::min(next + WINDOW, last);
+            file->advise(window_end * sizeof(T),
+                         std::min(window_end + WINDOW, last) * sizeof(T), MADV_WILLNEED);
+        }
+
+        return file->as<T>()[next++];
+    }
+};
+
+/***
+ * Buffered writer with two blocks: one is filled while the other one is
+ * written by an asynchronous task, so the merge overlaps the output I/O.
+ */
+template <typename T>
+class buffered_writer {
+    static constexpr std::size_t BLOCK = (8 << 20) / sizeof(T);
+
+    int fd;
+    std::vector<T> blocks[2];
+    int current = 0;
+    std::future<bool> pending;
+    bool failed = false;
+
+    void wait() {
+        if (pending.valid() && !pending.get()) failed = true;
+    }
+
+   public:
+    explicit buffered_writer(int fd) : fd(fd) {
+        blocks[0].reserve(BLOCK);
+        blocks[1].reserve(BLOCK);
+    }
+
+    ~buffered_writer() { wait(); }
+
+    void push(const T &value) {
+        blocks[current].push_back(value);
+        if (blocks[current].size() == BLOCK) flush();
+    }
+
+    /// Start writing the current block and switch to the other one.
+    void flush() {
+        wait();
+        auto &block = blocks[current];
+        pending = std::async(std::launch::async, [this, &block]() {
+            auto ok = write_all(fd, block.data(), block.size() * sizeof(T));
+            block.clear();
+            return ok;
+        });
+        current ^= 1;
+    }
+
+    /// Write what is buffered and wait for the writes; false on errors.
+    bool finish() {
+        if (!blocks[current].empty()) flush();
+        wait();
+        return !failed;
+    }
+};
+
+inline std::size_t physical_memory() {
+    auto pages = sysconf(_SC_PHYS_PAGES);
+    auto page = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page <= 0) return std::size_t{1} << 30;
+    return static_cast<std::size_t>(pages) * static_cast<std::size_t>(page);
+}
+
+}  // namespace detail
+
+struct external_sort_options {
+    /// Memory for the sort buffers, 0 means half of the physical memory
+    std::size_t memory = 0;
+    /// Directory of the temporary runs file (the output directory if empty)
+    std::string temp_dir{};
+};
+
+struct external_sort_report {
+    std::size_t elements = 0;
+    std::size_t runs = 0;
+    std::chrono::duration<double> run_time{0};
+    std::chrono::duration<double> merge_time{0};
+    /// Empty on success
+    std::string error{};
+};
+
+/***
+ * Sort the binary file of T at input into output, with memory bounded by
+ * options.memory whatever the file size:
+ *  1. runs: chunks of the mapped input are copied in RAM, sorted with
+ *     parallel_sort on the team and written to a temporary file; the next
+ *     chunk is read while the current one is sorted (two buffers, plus the
+ *     merge buffer of the sort: each chunk is a third of the memory);
+ *  2. merge: the runs are merged by a loser tree, reading them through
+ *     run_reader (kernel read-ahead of the next window) and writing through
+ *     buffered_writer (the next block is merged while the last is written).
+ * A single run is written directly to the output.
+ */
+template <typename T, typename Compare = std::less<T>>
+external_sort_report external_sort(const std::string &input, const std::string &output,
+                                   worker_team &team, const external_sort_options &options = {},
+                                   Compare less = {}) {
+    using clock = std::chrono::steady_clock;
+    external_sort_report report;
+
+    mapped_file in(input);
+    if (!in.ok()) {
+        report.error = "cannot map " + input + ": " + std::strerror(errno);
+        return report;
+    }
+    if (in.size() % sizeof(T) != 0) {
+        report.error = input + " is not a file of whole elements";
+        return report;
+    }
+    auto data = in.as<T>();
+    report.elements = data.size();
+    in.advise(0, in.size(), MADV_SEQUENTIAL);
+
+    auto memory = options.memory ? options.memory : detail::physical_memory() / 2;
+    auto chunk = std::max<std::size_t>(memory / (3 * sizeof(T)), 1);
+    auto runs = (data.size() + chunk - 1) / chunk;
+    report.runs = runs;
+
+    int out = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        report.error = "cannot create " + output + ": " + std::strerror(errno);
+        return report;
+    }
+
+    // A single run needs no temporary file
+    std::string runs_path;
+    int runs_fd = out;
+    if (runs > 1) {
+        auto dir = options.temp_dir;
+        if (dir.empty()) {
+            auto slash = output.rfind('/');
+            dir = (slash == std::string::npos) ? "." : output.substr(0, slash);
+        }
+        runs_path = dir + "/spm_runs_XXXXXX";
+        runs_fd = ::mkstemp(runs_path.data());
+        if (runs_fd < 0) {
+            report.error = "cannot create the runs file in " + dir + ": " + std::strerror(errno);
+            ::close(out);
+            return report;
+        }
+        // Removed as soon as it is closed, even if the program is killed
+        ::unlink(runs_path.c_str());
+    }
+
+    // 1. Runs
+    auto start = clock::now();
+    std::vector<T> buffers[2];
+    auto load = [&](std::size_t r, std::vector<T> &buffer) {
+        auto first = r * chunk, last = std::min(first + chunk, data.size());
+        buffer.assign(data.begin() + first, data.begin() + last);
+        // Read once: the pages can leave the page cache
+        in.advise(first * sizeof(T), last * sizeof(T), MADV_DONTNEED);
+    };
+
+    bool ok = true;
+    if (runs > 0) load(0, buffers[0]);
+    for (std::size_t r = 0; r < runs && ok; r++) {
+        auto &current = buffers[r % 2];
+        std::future<void> next;
+        if (r + 1 < runs) {
+            next = std::async(std::launch::async, load, r + 1, std::ref(buffers[(r + 1) % 2]));
+        }
+
+        parallel_sort(std::span<T>{current}, team, less);
+        ok = detail::write_all(runs_fd, current.data(), current.size() * sizeof(T));
+
+        if (next.valid()) next.get();
+    }
+    buffers[0] = {};
+    buffers[1] = {};
+    report.run_time = clock::now() - start;
+
+    // 2. Merge
+    start = clock::now();
+    if (ok && runs > 1) {
+        mapped_file runs_file(runs_fd);
+        ok = runs_file.ok();
+
+        if (ok) {
+            runs_file.advise(0, runs_file.size(), MADV_SEQUENTIAL);
+
+            std::vector<detail::run_reader<T>> readers;
+            std::vector<std::optional<T>> firsts;
+            for (std::size_t r = 0; r < runs; r++) {
+                readers.emplace_back(runs_file, r * chunk, std::min((r + 1) * chunk, data.size()));
+                firsts.push_back(readers.back().pop());
+            }
+
+            loser_tree<T, Compare> tree(std::move(firsts), less);
+            detail::buffered_writer<T> writer(out);
+            while (!tree.empty()) {
+                writer.push(tree.top_value());
+                tree.replace_top(readers[tree.top()].pop());
+            }
+            ok = writer.finish();
+        }
+    }
+    report.merge_time = clock::now() - start;
+
+    if (runs_fd != out) ::close(runs_fd);
+    if (::close(out) != 0) ok = false;
+    if (!ok && report.error.empty()) report.error = std::string("I/O error: ") + std::strerror(errno);
+
+    return report;
+}
+
+}  // namespace spm
+
+#endif
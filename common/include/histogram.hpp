@@ -0,0 +1,160 @@
+#ifndef SPM_HISTOGRAM_H
+#define SPM_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace spm {
+
+/***
+ * Log-linear histogram of non negative integers (e.g. latencies in ns), in
+ * the style of HdrHistogram: values below 2^SUB_BITS are counted exactly,
+ * larger ones in buckets whose width is a 2^-SUB_BITS fraction of the
+ * value. Recording is a couple of bit operations and an increment, the
+ * memory is fixed (~60 KB) whatever the number of samples, and percentiles
+ * are reported with a relative error below 1%.
+ */
+class histogram {
+    friend class concurrent_histogram;
+
+    static constexpr unsigned SUB_BITS = 7;
+    static constexpr std::uint64_t SUB_BUCKETS = 1ULL << SUB_BITS;
+    static constexpr std::size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    std::vector<std::uint64_t> counts = std::vector<std::uint64_t>(BUCKETS, 0);
+    std::uint64_t total = 0;
+    std::uint64_t smallest = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t largest = 0;
+    double sum = 0;
+
+    static std::size_t index_of(std::uint64_t value) noexcept {
+        if (value < SUB_BUCKETS) return static_cast<std::size_t>(value);
+
+        // Bucket group from the magnitude, bucket in the group from the
+        // SUB_BITS bits below the leading one
+        auto shift = static_cast<unsigned>(std::bit_width(value)) - SUB_BITS - 1;
+        return static_cast<std::size_t>((shift + 1) * SUB_BUCKETS + (value >> shift) -
+                                        SUB_BUCKETS);
+    }
+
+    /// Largest value counted in the bucket.
+    static std::uint64_t highest_of(std::size_t index) noexcept {
+        auto group = index / SUB_BUCKETS;
+        auto sub = index % SUB_BUCKETS;
+        if (group == 0) return sub;
+
+        auto shift = group - 1;
+        return ((sub + SUB_BUCKETS) << shift) + ((1ULL << shift) - 1);
+    }
+
+   public:
+    void record(std::uint64_t value) noexcept {
+        counts[index_of(value)]++;
+        total++;
+        sum += static_cast<double>(value);
+        smallest = std::min(smallest, value);
+        largest = std::max(largest, value);
+    }
+
+    /// Add the samples of other (e.g. the histogram of another thread).
+    void merge(const histogram &other) noexcept {
+        for (std::size_t i = 0; i < BUCKETS; i++) counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        smallest = std::min(smallest, other.smallest);
+        largest = std::max(largest, other.largest);
+    }
+
+    void reset() noexcept { *this = histogram{}; }
+
+    std::uint64_t count() const noexcept { return total; }
+    std::uint64_t min() const noexcept { return total ? smallest : 0; }
+    std::uint64_t max() const noexcept { return largest; }
+    double mean() const noexcept { return total ? sum / static_cast<double>(total) : 0.0; }
+
+    /// Smallest value not exceeded by the given percentage (0-100) of the samples.
+    std::uint64_t percentile(double p) const noexcept {
+        if (total == 0) return 0;
+
+        auto rank = static_cast<std::uint64_t>(std::ceil(p / 100.0 * static_cast<double>(total)));
+        rank = std::clamp<std::uint64_t>(rank, 1, total);
+
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(highest_of(i), largest);
+        }
+        return largest;
+    }
+
+    static void print_header(std::FILE *out = stdout, const char *unit = "ns") {
+        std::fprintf(out, "%-32s %10s %10s %10s %10s %10s %10s %10s %10s\n", "", "samples",
+                     (std::string("min ") + unit).c_str(), "mean", "p50", "p90", "p99", "p99.9",
+                     "max");
+    }
+
+    void print(const char *name, std::FILE *out = stdout) const {
+        std::fprintf(out, "%-32s %10llu %10llu %10.1f %10llu %10llu %10llu %10llu %10llu\n", name,
+                     static_cast<unsigned long long>(total),
+                     static_cast<unsigned long long>(min()), mean(),
+                     static_cast<unsigned long long>(percentile(50)),
+                     static_cast<unsigned long long>(percentile(90)),
+                     static_cast<unsigned long long>(percentile(99)),
+                     static_cast<unsigned long long>(percentile(99.9)),
+                     static_cast<unsigned long long>(max()));
+    }
+};
+
+/***
+ * histogram whose counters are relaxed atomics: it can be recorded by its
+ * owner thread while other threads take snapshots, e.g. always-on runtime
+ * metrics. Recording costs a few uncontended atomic increments; a snapshot
+ * copies the counters in a plain histogram, without stopping the writers
+ * (so its fields can be a few samples apart from each other).
+ */
+class concurrent_histogram {
+    std::vector<std::atomic<std::uint64_t>> counts =
+        std::vector<std::atomic<std::uint64_t>>(histogram::BUCKETS);
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> smallest{std::numeric_limits<std::uint64_t>::max()};
+    std::atomic<std::uint64_t> largest{0};
+
+   public:
+    void record(std::uint64_t value) noexcept {
+        constexpr auto relaxed = std::memory_order_relaxed;
+        counts[histogram::index_of(value)].fetch_add(1, relaxed);
+        total.fetch_add(1, relaxed);
+        sum.fetch_add(value, relaxed);
+
+        // Usually a single writer: the loops rarely retry
+        auto low = smallest.load(relaxed);
+        while (value < low && !smallest.compare_exchange_weak(low, value, relaxed)) {
+        }
+        auto high = largest.load(relaxed);
+        while (value > high && !largest.compare_exchange_weak(high, value, relaxed)) {
+        }
+    }
+
+    histogram snapshot() const {
+        constexpr auto relaxed = std::memory_order_relaxed;
+        histogram h;
+        for (std::size_t i = 0; i < histogram::BUCKETS; i++) h.counts[i] = counts[i].load(relaxed);
+        h.total = total.load(relaxed);
+        h.sum = static_cast<double>(sum.load(relaxed));
+        h.smallest = smallest.load(relaxed);
+        h.largest = largest.load(relaxed);
+        return h;
+    }
+};
+
+}  // namespace spm
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef SPM_KERNELS_H
+#define SPM_KERNELS_H
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+#include "spmutility.hpp"
+
+namespace spm {
+
+/***
+ * Allocator returning memory aligned to Alignment bytes. Elements are
+ * default-initialized, so the pages of a new vector are not touched by the
+ * allocating thread and first_touch() can place them on the right NUMA node.
+ */
+template <typename T, std::size_t Alignment = 64>
+struct aligned_allocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = aligned_allocator<U, Alignment>;
+    };
+
+    aligned_allocator() noexcept = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+    }
+
+    void deallocate(T *p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t{Alignment});
+    }
+
+    template <typename U>
+    void construct(U *p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+        ::new (static_cast<void *>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *p, Args &&...args) {
+        ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U, Alignment> &) const noexcept {
+        return true;
+    }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+namespace kernels {
+
+namespace detail {
+
+constexpr std::size_t CACHE_LINE = 64;
+
+/// Run body(begin, end) on the static block of each OpenMP thread. Blocks
+/// are multiple of a cache line, so the same partitioning used for the
+/// first touch is used by the kernels and no line is shared by two threads.
+template <typename T, typename Body>
+void parallel_blocks(std::size_t n, Body &&body) {
+    constexpr auto line = std::max<std::size_t>(CACHE_LINE / sizeof(T), 1);
+
+    #pragma omp parallel
+    {
+        auto nt = static_cast<std::size_t>(omp_get_num_threads());
+        auto id = static_cast<std::size_t>(omp_get_thread_num());
+
+        auto lines = (n + line - 1) / line;
+        auto begin = std::min(n, (lines * id / nt) * line);
+        auto end = std::min(n, (lines * (id + 1) / nt) * line);
+
+        if (begin < end) body(begin, end);
+    }
+}
+
+/// Arrays bigger than the last level cache are streamed to memory with
+/// non-temporal stores, smaller ones are better kept in cache.
+inline bool use_streaming_stores(std::size_t bytes) {
+    static const auto llc = get_llc_size();
+    return bytes > llc;
+}
+
+inline bool is_aligned(const void *p, std::size_t alignment) {
+    return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+}
+
+/// Vector registers for the element types with an explicit AVX2 path.
+template <typename T>
+struct simd {
+    static constexpr bool enabled = false;
+};
+
+#ifdef __AVX2__
+template <>
+struct simd<int> {
+    static constexpr bool enabled = true;
+    static constexpr std::size_t width = 8;
+    using reg = __m256i;
+
+    static reg load(const int *p) { return _mm256_load_si256(reinterpret_cast<const reg *>(p)); }
+    static reg loadu(const int *p) { return _mm256_loadu_si256(reinterpret_cast<const reg *>(p)); }
+    static void store(int *p, reg v) { _mm256_store_si256(reinterpret_cast<reg *>(p), v); }
+    static void stream(int *p, reg v) { _mm256_stream_si256(reinterpret_cast<reg *>(p), v); }
+    static reg set1(int x) { return _mm256_set1_epi32(x); }
+    static reg add(reg a, reg b) { return _mm256_add_epi32(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mullo_epi32(a, b); }
+};
+
+template <>
+struct simd<float> {
+    static constexpr bool enabled = true;
+    static constexpr std::size_t width = 8;
+    using reg = __m256;
+
+    static reg load(const float *p) { return _mm256_load_ps(p); }
+    static reg loadu(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, reg v) { _mm256_store_ps(p, v); }
+    static void stream(float *p, reg v) { _mm256_stream_ps(p, v); }
+    static reg set1(float x) { return _mm256_set1_ps(x); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+};
+
+template <>
+struct simd<double> {
+    static constexpr bool enabled = true;
+    static constexpr std::size_t width = 4;
+    using reg = __m256d;
+
+    static reg load(const double *p) { return _mm256_load_pd(p); }
+    static reg loadu(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, reg v) { _mm256_store_pd(p, v); }
+    static void stream(double *p, reg v) { _mm256_stream_pd(p, v); }
+    static reg set1(double x) { return _mm256_set1_pd(x); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+};
+#endif
+
+template <typename T, bool AlignedIn, bool Stream, typename VecOp, typename ScalarOp>
+void vector_loop(const T *a, const T *b, T *out, std::size_t i, std::size_t end,
+                 VecOp &&vop, ScalarOp &&sop) {
+    using v = simd<T>;
+
+    for (; i + v::width <= end; i += v::width) {
+        auto va = AlignedIn ? v::load(a + i) : v::loadu(a + i);
+        auto vb = AlignedIn ? v::load(b + i) : v::loadu(b + i);
+        if constexpr (Stream) {
+            v::stream(out + i, vop(va, vb));
+        } else {
+            v::store(out + i, vop(va, vb));
+        }
+    }
+    for (; i < end; i++) out[i] = sop(a[i], b[i]);
+}
+
+/***
+ * out[i] = op(a[i], b[i]) in parallel. out may alias a or b (in place).
+ * With an AVX2 path the output is peeled to a 32 byte boundary, so stores
+ * are always aligned, and inputs are loaded aligned when they share the
+ * alignment of the output.
+ */
+template <typename T, typename VecOp, typename ScalarOp>
+void binary(const T *a, const T *b, T *out, std::size_t n, std::size_t arrays,
+            VecOp &&vop, ScalarOp &&sop) {
+    auto streaming = use_streaming_stores(n * sizeof(T) * arrays);
+
+    parallel_blocks<T>(n, [&](std::size_t begin, std::size_t end) {
+        if constexpr (simd<T>::enabled) {
+            auto i = begin;
+            while (i < end && !is_aligned(out + i, 32)) {
+                out[i] = sop(a[i], b[i]);
+                i++;
+            }
+
+            auto aligned_in = is_aligned(a + i, 32) && is_aligned(b + i, 32);
+            if (streaming) {
+                if (aligned_in)
+                    vector_loop<T, true, true>(a, b, out, i, end, vop, sop);
+                else
+                    vector_loop<T, false, true>(a, b, out, i, end, vop, sop);
+#ifdef __AVX2__
+                // Non-temporal stores are weakly ordered
+                _mm_sfence();
+#endif
+            } else {
+                if (aligned_in)
+                    vector_loop<T, true, false>(a, b, out, i, end, vop, sop);
+                else
+                    vector_loop<T, false, false>(a, b, out, i, end, vop, sop);
+            }
+        } else {
+            #pragma omp simd
+            for (auto i = begin; i < end; i++) out[i] = sop(a[i], b[i]);
+        }
+    });
+}
+
+}  // namespace detail
+
+/// out = a + b (out may be a or b). Spans of different sizes are cut to the
+/// shortest one: the elements of out past it are left untouched.
+template <typename T>
+void add(std::span<const T> a, std::span<const T> b, std::span<T> out) {
+    using v = detail::simd<T>;
+    auto sop = [](T x, T y) { return x + y; };
+    auto n = std::min({a.size(), b.size(), out.size()});
+
+    if constexpr (v::enabled) {
+        detail::binary<T>(
+            a.data(), b.data(), out.data(), n, 3,
+            [](auto x, auto y) { return v::add(x, y); }, sop);
+    } else {
+        detail::binary<T>(a.data(), b.data(), out.data(), n, 3, nullptr, sop);
+    }
+}
+
+/// out = alpha * x (out may be x), over the shortest of the two spans.
+template <typename T>
+void scale(T alpha, std::span<const T> x, std::span<T> out) {
+    using v = detail::simd<T>;
+    auto sop = [alpha](T a, T) { return alpha * a; };
+    auto n = std::min(x.size(), out.size());
+
+    if constexpr (v::enabled) {
+        auto valpha = v::set1(alpha);
+        detail::binary<T>(
+            x.data(), x.data(), out.data(), n, 2,
+            [valpha](auto a, auto) { return v::mul(valpha, a); }, sop);
+    } else {
+        detail::binary<T>(x.data(), x.data(), out.data(), n, 2, nullptr, sop);
+    }
+}
+
+/// y = alpha * x + y, over the shortest of the two spans.
+template <typename T>
+void axpy(T alpha, std::span<const T> x, std::span<T> y) {
+    using v = detail::simd<T>;
+    auto sop = [alpha](T a, T b) { return alpha * a + b; };
+    auto n = std::min(x.size(), y.size());
+
+    if constexpr (v::enabled) {
+        auto valpha = v::set1(alpha);
+        detail::binary<T>(
+            x.data(), y.data(), y.data(), n, 3,
+            [valpha](auto a, auto b) { return v::add(v::mul(valpha, a), b); }, sop);
+    } else {
+        detail::binary<T>(x.data(), y.data(), y.data(), n, 3, nullptr, sop);
+    }
+}
+
+/// Fused element-wise map: out[i] = f(a[i], b[i]), vectorized by the compiler,
+/// over the shortest of the three spans.
+template <typename T, typename F>
+void map(F &&f, std::span<const T> a, std::span<const T> b, std::span<T> out) {
+    auto n = std::min({a.size(), b.size(), out.size()});
+    detail::parallel_blocks<T>(n, [&](std::size_t begin, std::size_t end) {
+        #pragma omp simd
+        for (auto i = begin; i < end; i++) out[i] = f(a[i], b[i]);
+    });
+}
+
+/***
+ * Initialize v[i] = init(i) with the same static partitioning of the kernels,
+ * so each page is first touched (and therefore allocated on the NUMA node of)
+ * the thread that will later work on it.
+ */
+template <typename T, typename F>
+void first_touch(std::span<T> v, F &&init) {
+    detail::parallel_blocks<T>(v.size(), [&](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; i++) v[i] = init(i);
+    });
+}
+
+template <typename T>
+void first_touch(std::span<T> v) {
+    first_touch(v, [](std::size_t) { return T{}; });
+}
+
+}  // namespace kernels
+}  // namespace spm
+
+#endif
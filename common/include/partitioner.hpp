@@ -0,0 +1,243 @@
+#ifndef SPM_PARTITIONER_H
+#define SPM_PARTITIONER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace spm {
+
+/// Half-open range of loop iterations: [first, second).
+using range = std::pair<std::size_t, std::size_t>;
+
+/// Scheduling policies understood by the loop scheduler.
+///  - block:    nw contiguous ranges of equal size (OpenMP static)
+///  - cost:     nw contiguous ranges of equal estimated cost
+///  - dynamic:  fixed size chunks taken on demand
+///  - guided:   chunks proportional to the remaining iterations
+///  - adaptive: chunks proportional to the remaining estimated cost
+enum class schedule { block, cost, dynamic, guided, adaptive };
+
+inline std::optional<schedule> parse_schedule(std::string_view name) noexcept {
+    if (name == "static") return schedule::block;
+    if (name == "cost") return schedule::cost;
+    if (name == "dynamic") return schedule::dynamic;
+    if (name == "guided") return schedule::guided;
+    if (name == "adaptive") return schedule::adaptive;
+    return std::nullopt;
+}
+
+/***
+ * Cumulative cost of the iterations of a loop, estimated by sampling a per
+ * iteration cost function (e.g. sqrt(i) for trial division) on a grid.
+ * Ranges with less iterations than samples are evaluated exactly.
+ */
+class cost_model {
+    std::vector<std::size_t> points;
+    std::vector<double> prefix;
+
+   public:
+    static constexpr std::size_t DEFAULT_SAMPLES = 4096;
+
+    template <typename Cost>
+    cost_model(std::size_t first, std::size_t last, Cost &&cost,
+               std::size_t samples = DEFAULT_SAMPLES) {
+        auto n = (last > first) ? last - first : 0;
+        auto s = std::clamp<std::size_t>(samples, 1, std::max<std::size_t>(n, 1));
+
+        points.resize(s + 1);
+        prefix.resize(s + 1);
+
+        for (std::size_t k = 0; k <= s; k++) {
+            points[k] = first + (n / s) * k + ((n % s) * k) / s;
+        }
+
+        // Midpoint rule: exact when each segment holds a single iteration
+        prefix[0] = 0.0;
+        for (std::size_t k = 0; k < s; k++) {
+            auto width = points[k + 1] - points[k];
+            auto mid = points[k] + width / 2;
+            prefix[k + 1] =
+                prefix[k] + static_cast<double>(cost(mid)) * static_cast<double>(width);
+        }
+    }
+
+    std::size_t first() const noexcept { return points.front(); }
+    std::size_t last() const noexcept { return points.back(); }
+    double total() const noexcept { return prefix.back(); }
+
+    /// Estimated cost of the iterations in [first(), i).
+    double cumulative(std::size_t i) const noexcept {
+        if (i <= first()) return 0.0;
+        if (i >= last()) return total();
+
+        auto k = static_cast<std::size_t>(
+            std::upper_bound(points.begin(), points.end(), i) - points.begin() - 1);
+        auto width = static_cast<double>(points[k + 1] - points[k]);
+        auto frac = static_cast<double>(i - points[k]) / width;
+
+        return prefix[k] + frac * (prefix[k + 1] - prefix[k]);
+    }
+
+    /// Smallest iteration i such that cumulative(i) >= c.
+    std::size_t inverse(double c) const noexcept {
+        if (c <= 0.0) return first();
+        if (c >= total()) return last();
+
+        auto k = static_cast<std::size_t>(
+            std::upper_bound(prefix.begin(), prefix.end(), c) - prefix.begin() - 1);
+        auto width = points[k + 1] - points[k];
+        auto frac = (c - prefix[k]) / (prefix[k + 1] - prefix[k]);
+        auto offset = static_cast<std::size_t>(std::ceil(frac * static_cast<double>(width)));
+
+        return points[k] + std::min(offset, width);
+    }
+};
+
+/// Split [first, last) in nw contiguous ranges whose sizes differ at most by one.
+inline std::vector<range> block_partition(std::size_t first, std::size_t last,
+                                          std::size_t nw) {
+    std::vector<range> ranges(nw);
+
+    auto n = (last > first) ? last - first : 0;
+    auto delta = n / nw;
+    auto extra = n % nw;
+
+    auto begin = first;
+    for (std::size_t i = 0; i < nw; i++) {
+        auto end = begin + delta + (i < extra ? 1 : 0);
+        ranges[i] = range(begin, end);
+        begin = end;
+    }
+
+    return ranges;
+}
+
+/// Split the range covered by the model in nw contiguous ranges of equal cost.
+inline std::vector<range> cost_partition(const cost_model &model, std::size_t nw) {
+    std::vector<range> ranges(nw);
+
+    auto begin = model.first();
+    for (std::size_t i = 0; i < nw; i++) {
+        auto end = (i != nw - 1)
+                       ? std::max(begin, model.inverse(model.total() * (i + 1) / nw))
+                       : model.last();
+        ranges[i] = range(begin, end);
+        begin = end;
+    }
+
+    return ranges;
+}
+
+/***
+ * Hands out the iterations of [first, last) to nw workers according to a
+ * schedule. Workers call next(id) until it returns std::nullopt.
+ * Static schedules (block, cost) give each worker id exactly one range,
+ * the other ones share an atomic cursor so any id can be used.
+ */
+class loop_scheduler {
+    schedule policy;
+    std::size_t first;
+    std::size_t last;
+    std::size_t nw;
+    /// Minimum chunk size for the on-demand schedules
+    std::size_t chunk;
+
+    std::optional<cost_model> model{};
+    std::vector<range> ranges{};
+    std::vector<std::atomic_flag> claimed;
+
+    alignas(64) std::atomic<std::size_t> cursor;
+
+    std::optional<range> next_static(std::size_t worker) noexcept {
+        if (worker >= nw || claimed[worker].test_and_set()) return std::nullopt;
+        if (ranges[worker].first >= ranges[worker].second) return std::nullopt;
+        return ranges[worker];
+    }
+
+    std::optional<range> next_dynamic() noexcept {
+        auto begin = cursor.fetch_add(chunk, std::memory_order_relaxed);
+        if (begin >= last) return std::nullopt;
+        return range(begin, std::min(begin + chunk, last));
+    }
+
+    template <typename Size>
+    std::optional<range> next_shrinking(Size &&size) noexcept {
+        auto begin = cursor.load(std::memory_order_relaxed);
+        std::size_t end;
+
+        do {
+            if (begin >= last) return std::nullopt;
+            end = std::min(last, begin + std::max(chunk, size(begin)));
+        } while (!cursor.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+
+        return range(begin, end);
+    }
+
+   public:
+    loop_scheduler(std::size_t first, std::size_t last, std::size_t nw,
+                   schedule policy, std::size_t chunk = 1)
+        : loop_scheduler(first, last, nw, policy, [](std::size_t) { return 1.0; },
+                         chunk) {}
+
+    template <std::invocable<std::size_t> Cost>
+    loop_scheduler(std::size_t first, std::size_t last, std::size_t nw,
+                   schedule policy, Cost &&cost, std::size_t chunk = 1)
+        : policy{policy},
+          first{first},
+          last{std::max(first, last)},
+          nw{std::max<std::size_t>(nw, 1)},
+          chunk{std::max<std::size_t>(chunk, 1)},
+          claimed(this->nw),
+          cursor{first} {
+        switch (policy) {
+            case schedule::block:
+                ranges = block_partition(first, this->last, this->nw);
+                break;
+            case schedule::cost:
+                model.emplace(first, this->last, std::forward<Cost>(cost));
+                ranges = cost_partition(*model, this->nw);
+                break;
+            case schedule::adaptive:
+                model.emplace(first, this->last, std::forward<Cost>(cost));
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::optional<range> next(std::size_t worker) noexcept {
+        switch (policy) {
+            case schedule::block:
+            case schedule::cost:
+                return next_static(worker);
+            case schedule::dynamic:
+                return next_dynamic();
+            case schedule::guided:
+                return next_shrinking(
+                    [&](std::size_t begin) { return (last - begin) / nw; });
+            case schedule::adaptive:
+                // Give away half of the fair share of the remaining cost, so
+                // the expensive iterations end up in smaller chunks
+                return next_shrinking([&](std::size_t begin) {
+                    auto done = model->cumulative(begin);
+                    auto target = (model->total() - done) / (2.0 * nw);
+                    return model->inverse(done + target) - begin;
+                });
+        }
+        return std::nullopt;
+    }
+
+    /// Static ranges assigned to the workers (empty for on-demand schedules).
+    const std::vector<range> &partitions() const noexcept { return ranges; }
+};
+
+}  // namespace spm
+
+#endif
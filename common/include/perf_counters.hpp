@@ -0,0 +1,273 @@
+#ifndef SPM_PERF_COUNTERS_H
+#define SPM_PERF_COUNTERS_H
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace spm {
+
+/// Counts of a measured region; a counter is empty when it could not be opened.
+struct perf_sample {
+    std::optional<std::uint64_t> cycles;
+    std::optional<std::uint64_t> instructions;
+    std::optional<std::uint64_t> cache_references;
+    std::optional<std::uint64_t> cache_misses;
+    std::optional<std::uint64_t> branch_misses;
+    std::optional<std::uint64_t> context_switches;
+
+    /// Instructions per cycle.
+    std::optional<double> ipc() const { return ratio(instructions, cycles); }
+
+    /// Fraction of the (last level) cache references that missed.
+    std::optional<double> cache_miss_rate() const { return ratio(cache_misses, cache_references); }
+
+    /// Branch misses every thousand instructions.
+    std::optional<double> branch_mpki() const {
+        auto r = ratio(branch_misses, instructions);
+        return r ? std::optional<double>(*r * 1000) : std::nullopt;
+    }
+
+    void print(const char *name, std::FILE *out = stdout) const {
+        auto count = [](const std::optional<std::uint64_t> &c) {
+            return c ? std::to_string(*c) : std::string("n/a");
+        };
+        auto value = [](const std::optional<double> &v, double scale) {
+            char buffer[32] = "n/a";
+            if (v) std::snprintf(buffer, sizeof(buffer), "%.2f", *v * scale);
+            return std::string(buffer);
+        };
+
+        std::fprintf(out,
+                     "%s: IPC %s, cache miss rate %s%%, branch MPKI %s "
+                     "(cycles %s, instructions %s, cache refs %s, cache misses %s, "
+                     "branch misses %s, context switches %s)\n",
+                     name, value(ipc(), 1).c_str(), value(cache_miss_rate(), 100).c_str(),
+                     value(branch_mpki(), 1).c_str(), count(cycles).c_str(),
+                     count(instructions).c_str(), count(cache_references).c_str(),
+                     count(cache_misses).c_str(), count(branch_misses).c_str(),
+                     count(context_switches).c_str());
+    }
+
+   private:
+    static std::optional<double> ratio(const std::optional<std::uint64_t> &a,
+                                       const std::optional<std::uint64_t> &b) {
+        if (!a || !b || *b == 0) return std::nullopt;
+        return static_cast<double>(*a) / static_cast<double>(*b);
+    }
+};
+
+/***
+ * Hardware counters of a region through perf_event_open(2). With
+ * scope::thread only the calling thread is counted; with scope::process the
+ * calling thread and the threads it spawns after the counters are created
+ * (e.g. the workers of a parallel sort, or the OpenMP pool).
+ *
+ * Counters the kernel refuses (perf_event_paranoid, containers, VMs without
+ * a PMU) are left out and reported as n/a, so the program keeps working.
+ * Counts are scaled when the kernel multiplexes more events than registers.
+ *
+ * With scope::thread the hardware events form a group: the first one opened
+ * leads, they are scheduled on the PMU all together and read at once, so
+ * ratios like the IPC compare counts of the same instants. Inherited events
+ * cannot be read as a group, so with scope::process each event is separate
+ * and multiplexed on its own: its count is scaled independently.
+ */
+class perf_counters {
+   public:
+    enum class scope { thread, process };
+
+   private:
+    static constexpr std::size_t EVENTS = 6;
+
+    /// Raw value, time enabled and time running of an event.
+    using reading = std::array<std::uint64_t, 3>;
+
+    std::array<int, EVENTS> fds;
+    /// Group leader of the hardware events (scope::thread), -1 if none
+    int leader = -1;
+    /// Position of each event in the group read, NONE if not in the group
+    static constexpr std::size_t NONE = EVENTS;
+    std::array<std::size_t, EVENTS> slot;
+    /// Readings at start(): the counts of exited inherited threads cannot be
+    /// reset, so regions are measured as differences.
+    std::array<reading, EVENTS> baseline{};
+    std::string why_unavailable;
+
+#ifdef __linux__
+    static int open_event(std::uint32_t type, std::uint64_t config, scope s, int group_fd) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = (s == scope::process) ? 1 : 0;
+        // User space only (allowed with perf_event_paranoid = 2); context
+        // switches happen in the kernel, so they would always count zero
+        attr.exclude_kernel = (type == PERF_TYPE_HARDWARE) ? 1 : 0;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // The group is read at once, through its leader
+        if (s == scope::thread && type == PERF_TYPE_HARDWARE)
+            attr.read_format |= PERF_FORMAT_GROUP;
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+
+    static reading read_event(int fd) {
+        reading r = {0, 0, 0};
+        if (fd >= 0 && read(fd, r.data(), sizeof(r)) != static_cast<ssize_t>(sizeof(r)))
+            r = {0, 0, 0};
+        return r;
+    }
+
+    /// Current readings of all the events, the group with a single read.
+    std::array<reading, EVENTS> read_all() const {
+        std::array<reading, EVENTS> now{};
+        if (leader >= 0) {
+            // Number of events, time enabled, time running, then the values
+            std::array<std::uint64_t, 3 + EVENTS> group{};
+            if (read(leader, group.data(), sizeof(group)) > 0) {
+                for (std::size_t i = 0; i < EVENTS; i++) {
+                    if (slot[i] != NONE && slot[i] < group[0])
+                        now[i] = {group[3 + slot[i]], group[1], group[2]};
+                }
+            }
+        }
+        for (std::size_t i = 0; i < EVENTS; i++) {
+            if (slot[i] == NONE) now[i] = read_event(fds[i]);
+        }
+        return now;
+    }
+
+    std::optional<std::uint64_t> count(std::size_t i, const reading &now) const {
+        if (fds[i] < 0) return std::nullopt;
+
+        auto value = now[0] - baseline[i][0];
+        auto enabled = now[1] - baseline[i][1];
+        auto running = now[2] - baseline[i][2];
+
+        if (running == enabled) return value;
+        // Never scheduled on the PMU during the region
+        if (running == 0) return std::nullopt;
+
+        auto scale = static_cast<double>(enabled) / static_cast<double>(running);
+        return static_cast<std::uint64_t>(static_cast<double>(value) * scale);
+    }
+#endif
+
+   public:
+    explicit perf_counters(scope s = scope::process) {
+        fds.fill(-1);
+        slot.fill(NONE);
+#ifdef __linux__
+        const std::array<std::pair<std::uint32_t, std::uint64_t>, EVENTS> events = {{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+        }};
+
+        int error = 0;
+        std::size_t grouped = 0;
+        for (std::size_t i = 0; i < EVENTS; i++) {
+            auto group = (s == scope::thread && events[i].first == PERF_TYPE_HARDWARE);
+            fds[i] = open_event(events[i].first, events[i].second, s, group ? leader : -1);
+            if (fds[i] < 0) {
+                if (error == 0) error = errno;
+                continue;
+            }
+            if (group) {
+                if (leader < 0) leader = fds[i];
+                slot[i] = grouped++;
+            }
+        }
+
+        if (!available()) {
+            why_unavailable = std::strerror(error);
+            if (error == EACCES || error == EPERM)
+                why_unavailable += " (see /proc/sys/kernel/perf_event_paranoid)";
+        }
+#else
+        (void)s;
+        why_unavailable = "perf_event_open is available only on Linux";
+#endif
+    }
+
+    ~perf_counters() {
+#ifdef __linux__
+        for (auto fd : fds)
+            if (fd >= 0) close(fd);
+#endif
+    }
+
+    perf_counters(const perf_counters &) = delete;
+    perf_counters &operator=(const perf_counters &) = delete;
+
+    /// Whether at least one counter could be opened.
+    bool available() const noexcept {
+        for (auto fd : fds)
+            if (fd >= 0) return true;
+        return false;
+    }
+
+    /// Reason of the failure when no counter is available.
+    const std::string &error() const noexcept { return why_unavailable; }
+
+    /// Start counting.
+    void start() noexcept {
+#ifdef __linux__
+        baseline = read_all();
+        if (leader >= 0) ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        for (std::size_t i = 0; i < EVENTS; i++) {
+            if (fds[i] >= 0 && slot[i] == NONE) ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /// Stop counting and read the counts since start().
+    perf_sample stop() {
+        perf_sample s;
+#ifdef __linux__
+        if (leader >= 0) ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        for (std::size_t i = 0; i < EVENTS; i++) {
+            if (fds[i] >= 0 && slot[i] == NONE) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+
+        auto now = read_all();
+        s.cycles = count(0, now[0]);
+        s.instructions = count(1, now[1]);
+        s.cache_references = count(2, now[2]);
+        s.cache_misses = count(3, now[3]);
+        s.branch_misses = count(4, now[4]);
+        s.context_switches = count(5, now[5]);
+#endif
+        return s;
+    }
+
+    /// Count the events of f().
+    template <typename Fun>
+    perf_sample measure(Fun &&f) {
+        start();
+        f();
+        return stop();
+    }
+};
+
+}  // namespace spm
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef SPM_PRIME_COUNT_H
+#define SPM_PRIME_COUNT_H
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace spm {
+
+namespace detail {
+
+inline std::uint64_t isqrt(std::uint64_t n) noexcept {
+    auto r = static_cast<std::uint64_t>(std::sqrt(static_cast<long double>(n)));
+    while (r > 0 && r > n / r) r--;
+    while (r + 1 <= n / (r + 1)) r++;
+    return r;
+}
+
+/// floor(n / d) through a multiplication by 1/d: below 2^53 the estimate
+/// is off by at most one and is corrected with integer products, above
+/// the double loses too many digits and the integer division is used.
+struct fast_divider {
+    static constexpr std::uint64_t EXACT_BELOW = std::uint64_t{1} << 53;
+
+    std::uint64_t d;
+    double inverse;
+
+    explicit fast_divider(std::uint64_t d) : d(d), inverse(1.0 / static_cast<double>(d)) {}
+
+    std::uint64_t operator()(std::uint64_t n) const noexcept {
+        if (n >= EXACT_BELOW) return n / d;
+        auto q = static_cast<std::uint64_t>(static_cast<double>(n) * inverse);
+        if (q * d > n) q--;
+        else if ((q + 1) * d <= n) q++;
+        return q;
+    }
+};
+
+/// Run body(i) for i in [first, last) on nw OpenMP threads, sequentially
+/// when the range is too short to pay for the parallel region.
+template <typename Body>
+void parallel_range(std::uint64_t first, std::uint64_t last, int nw, Body &&body) {
+    constexpr std::uint64_t MIN_PARALLEL = 1 << 14;
+    if (last <= first) return;
+
+    #pragma omp parallel for schedule(static) num_threads(nw) if (last - first >= MIN_PARALLEL)
+    for (std::uint64_t i = first; i < last; i++) body(i);
+}
+
+}  // namespace detail
+
+/***
+ * π(x), the number of primes <= x, with the Lucy_Hedgehog algorithm in
+ * O(x^{3/4}) time and O(√x) memory (π(10^13) in seconds, where testing each
+ * number would take days). S(v) counts the numbers in [2, v] left by a
+ * partial sieve, for the values v = x / i only; sieving a prime p updates
+ *
+ *     S(v) -= S(v / p) - S(p - 1)    for v >= p^2
+ *
+ * and once every p <= √x is sieved S(x) = π(x). The updates of a round are
+ * parallel: v reads S(v / p), which this round updates too when v / p >= p^2,
+ * so the values are split in levels by powers of p, each level reading only
+ * the next one, and the levels run in order, each on nw threads.
+ */
+inline std::uint64_t prime_pi(std::uint64_t x, int nw = omp_get_max_threads()) {
+    using u64 = std::uint64_t;
+    if (x < 2) return 0;
+
+    auto r = detail::isqrt(x);
+    // small[v] = S(v) for v <= r, large[i] = S(x / i) for i <= r
+    std::vector<u64> small(r + 1), large(r + 1), quotient(r + 1);
+    detail::parallel_range(0, r + 1, nw, [&](u64 v) { small[v] = v > 0 ? v - 1 : 0; });
+    detail::parallel_range(1, r + 1, nw, [&](u64 i) {
+        quotient[i] = x / i;
+        large[i] = quotient[i] - 1;
+    });
+
+    for (u64 p = 2; p <= r; p++) {
+        // p is prime iff the previous rounds did not sieve it out
+        if (small[p] == small[p - 1]) continue;
+
+        auto sp = small[p - 1];
+        auto p2 = p * p;
+        detail::fast_divider div(p);
+
+        // Large values: i reads i * p, from the level after its own
+        auto limit = std::min(r, x / p2);
+        std::vector<u64> bounds{limit};
+        while (bounds.back() > 0) bounds.push_back(bounds.back() / p);
+        for (auto k = bounds.size() - 1; k > 0; k--) {
+            detail::parallel_range(bounds[k] + 1, bounds[k - 1] + 1, nw, [&](u64 i) {
+                auto j = i * p;
+                auto s = (j <= r) ? large[j] : small[div(quotient[i])];
+                large[i] -= s - sp;
+            });
+        }
+
+        // Small values, after the large ones which read them: v reads v / p,
+        // from the level before its own, so the highest level goes first
+        if (p2 > r) continue;
+        std::vector<u64> starts{p2};
+        while (starts.back() <= r / p) starts.push_back(starts.back() * p);
+        for (auto k = starts.size(); k > 0; k--) {
+            auto first = starts[k - 1];
+            auto last = (k < starts.size()) ? starts[k] : r + 1;
+            detail::parallel_range(first, last, nw,
+                                   [&](u64 v) { small[v] -= small[div(v)] - sp; });
+        }
+    }
+
+    return large[1];
+}
+
+}  // namespace spm
+
+#endif
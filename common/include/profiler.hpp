@@ -0,0 +1,200 @@
+#ifndef SPM_PROFILER_H
+#define SPM_PROFILER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tsc.hpp"
+
+namespace spm {
+
+/***
+ * Hierarchical profiler of scoped regions. Each thread aggregates (count,
+ * total, min, max) of its regions in its own tree, so entering and leaving
+ * a region costs a TSC read and a few stores: no locks, no atomics, no
+ * allocations once the tree is built. The trees of all the threads are
+ * merged by region path when the report is printed.
+ *
+ * Region names must be string literals (they are compared by address).
+ * Reports must be taken once the profiled threads are done, e.g. at exit.
+ */
+class profiler {
+   public:
+    struct region_stats {
+        std::uint64_t count = 0;
+        std::uint64_t total = 0;
+        std::uint64_t min = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t max = 0;
+
+        void add(std::uint64_t ticks) noexcept {
+            count++;
+            total += ticks;
+            min = std::min(min, ticks);
+            max = std::max(max, ticks);
+        }
+
+        void merge(const region_stats &other) noexcept {
+            count += other.count;
+            total += other.total;
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+        }
+    };
+
+   private:
+    /// Order paths as a depth first visit of the tree ("a/b" before "a b").
+    struct path_order {
+        bool operator()(const std::string &a, const std::string &b) const {
+            return std::lexicographical_compare(
+                a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+                    return (x == '/' ? '\0' : x) < (y == '/' ? '\0' : y);
+                });
+        }
+    };
+
+    using region_map = std::map<std::string, region_stats, path_order>;
+
+    struct node {
+        const char *name;
+        std::size_t parent;
+        std::vector<std::size_t> children{};
+        region_stats stats{};
+    };
+
+    /// Region tree of a thread, node 0 is the (unnamed) root.
+    struct thread_data {
+        std::vector<node> nodes{node{"", 0}};
+        std::size_t current = 0;
+    };
+
+    std::mutex registry_lock;
+    std::vector<std::shared_ptr<thread_data>> registry;
+    tsc_clock clock;
+    std::FILE *report_at_exit = nullptr;
+
+    profiler() = default;
+
+    thread_data &local() {
+        // The registry keeps the data alive after the thread exits
+        thread_local std::shared_ptr<thread_data> data = [this]() {
+            auto d = std::make_shared<thread_data>();
+            std::lock_guard<std::mutex> lock(registry_lock);
+            registry.push_back(d);
+            return d;
+        }();
+        return *data;
+    }
+
+    void merge_into(const thread_data &t, std::size_t n, const std::string &path,
+                    region_map &merged) const {
+        for (auto c : t.nodes[n].children) {
+            auto child_path = path.empty() ? std::string(t.nodes[c].name)
+                                           : path + "/" + t.nodes[c].name;
+            merged[child_path].merge(t.nodes[c].stats);
+            merge_into(t, c, child_path, merged);
+        }
+    }
+
+   public:
+    ~profiler() {
+        if (report_at_exit != nullptr) report(report_at_exit);
+    }
+
+    static profiler &instance() {
+        static profiler p;
+        return p;
+    }
+
+    /// Print the report when the program exits.
+    void enable_report_at_exit(std::FILE *out = stderr) noexcept { report_at_exit = out; }
+
+    std::size_t enter(const char *name) {
+        auto &t = local();
+        auto &children = t.nodes[t.current].children;
+
+        auto it = std::find_if(children.begin(), children.end(),
+                               [&](std::size_t c) { return t.nodes[c].name == name; });
+        std::size_t child;
+        if (it != children.end()) {
+            child = *it;
+        } else {
+            child = t.nodes.size();
+            t.nodes.push_back(node{name, t.current});
+            t.nodes[t.current].children.push_back(child);
+        }
+
+        t.current = child;
+        return child;
+    }
+
+    void leave(std::size_t region, std::uint64_t ticks) {
+        auto &t = local();
+        t.nodes[region].stats.add(ticks);
+        t.current = t.nodes[region].parent;
+    }
+
+    /// Aggregated stats of every region path (e.g. "sort/odd phase") of all the threads.
+    region_map merged() {
+        region_map result;
+        std::lock_guard<std::mutex> lock(registry_lock);
+        for (const auto &t : registry) merge_into(*t, 0, "", result);
+        return result;
+    }
+
+    void report(std::FILE *out = stderr) {
+        auto regions = merged();
+        if (regions.empty()) return;
+
+        std::fprintf(out, "%-40s %12s %14s %12s %12s %12s\n", "region", "count", "total (ms)",
+                     "avg (μs)", "min (μs)", "max (μs)");
+        for (const auto &[path, s] : regions) {
+            // Indent nested regions, showing only the last name of the path
+            auto depth = std::count(path.begin(), path.end(), '/');
+            auto name = std::string(2 * depth, ' ') + path.substr(path.rfind('/') + 1);
+            auto to_us = [&](std::uint64_t ticks) { return clock.to_ns(ticks) / 1000.0; };
+
+            std::fprintf(out, "%-40s %12llu %14.3f %12.3f %12.3f %12.3f\n", name.c_str(),
+                         static_cast<unsigned long long>(s.count), to_us(s.total) / 1000.0,
+                         to_us(s.total) / static_cast<double>(s.count), to_us(s.min),
+                         to_us(s.max));
+        }
+    }
+};
+
+/// RAII region: profiles the enclosing scope.
+class scoped_region {
+    std::size_t region;
+    std::uint64_t start;
+
+   public:
+    explicit scoped_region(const char *name)
+        : region(profiler::instance().enter(name)), start(tsc()) {}
+
+    ~scoped_region() { profiler::instance().leave(region, tsc() - start); }
+
+    scoped_region(const scoped_region &) = delete;
+    scoped_region &operator=(const scoped_region &) = delete;
+};
+
+}  // namespace spm
+
+#define SPM_PROFILE_CONCAT_(a, b) a##b
+#define SPM_PROFILE_CONCAT(a, b) SPM_PROFILE_CONCAT_(a, b)
+
+/// Profile the enclosing scope as a region named name (a string literal).
+/// Building with -DSPM_PROFILER_DISABLED compiles the regions away.
+#ifdef SPM_PROFILER_DISABLED
+    #define SPM_PROFILE_SCOPE(name)
+#else
+    #define SPM_PROFILE_SCOPE(name) \
+        spm::scoped_region SPM_PROFILE_CONCAT(spm_profile_region_, __LINE__)(name)
+#endif
+
+#endif
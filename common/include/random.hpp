@@ -0,0 +1,128 @@
+#ifndef SPM_RANDOM_H
+#define SPM_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "partitioner.hpp"
+
+namespace spm {
+
+/***
+ * Counter-based random numbers: the i-th number of the stream of a seed is
+ * a pure function of (seed, i), computed with the SplitMix64 mixer. Any
+ * range of the stream can then be generated independently, so the output
+ * for a given seed is the same whatever the number of threads.
+ */
+constexpr std::uint64_t random_at(std::uint64_t seed, std::uint64_t i) noexcept {
+    std::uint64_t z = seed + (i + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/// i-th number of the stream mapped to [min, max] (multiply-shift, no divisions).
+constexpr int uniform_at(std::uint64_t seed, std::uint64_t i, int min, int max) noexcept {
+    auto range = static_cast<std::uint64_t>(static_cast<std::int64_t>(max) - min + 1);
+    auto offset = ((random_at(seed, i) >> 32) * range) >> 32;
+    return static_cast<int>(static_cast<std::int64_t>(min) + static_cast<std::int64_t>(offset));
+}
+
+/// Shape of the generated data.
+///  - uniform:        independent values in [min, max]
+///  - sorted:         non decreasing values spread over [min, max]
+///  - reverse_sorted: non increasing values spread over [min, max]
+///  - nearly_sorted:  sorted, except for 1% of the positions holding a random value
+///  - few_unique:     values drawn from a set of 16 random values
+enum class distribution { uniform, sorted, reverse_sorted, nearly_sorted, few_unique };
+
+inline std::optional<distribution> parse_distribution(std::string_view name) noexcept {
+    if (name == "uniform") return distribution::uniform;
+    if (name == "sorted") return distribution::sorted;
+    if (name == "reverse") return distribution::reverse_sorted;
+    if (name == "nearly") return distribution::nearly_sorted;
+    if (name == "few") return distribution::few_unique;
+    return std::nullopt;
+}
+
+namespace detail {
+
+/// Stratified sorted sample: v[i] = min + floor(range * (i + u_i) / n), with
+/// u_i in [0, 1). It is non decreasing by construction and needs no sort.
+inline int sorted_at(std::uint64_t seed, std::uint64_t i, std::uint64_t n, int min,
+                     int max) noexcept {
+    auto range = static_cast<double>(static_cast<std::int64_t>(max) - min + 1);
+    auto u = static_cast<double>(random_at(seed, i) >> 11) * 0x1.0p-53;
+    auto offset = static_cast<std::int64_t>(range * (static_cast<double>(i) + u) /
+                                            static_cast<double>(n));
+    return static_cast<int>(std::min<std::int64_t>(static_cast<std::int64_t>(min) + offset, max));
+}
+
+/// Independent streams for the different uses of the same seed.
+constexpr std::uint64_t SALT_NOISE = 0x5851f42d4c957f2dULL;
+constexpr std::uint64_t SALT_VALUES = 0x14057b7ef767814fULL;
+
+inline void fill_range(int *v, std::uint64_t first, std::uint64_t last, std::uint64_t n,
+                       int min, int max, std::uint64_t seed, distribution dist) noexcept {
+    constexpr std::uint64_t FEW_UNIQUE = 16;
+
+    switch (dist) {
+        case distribution::uniform:
+            // No loop carried dependencies: the compiler vectorizes the mixer
+            for (auto i = first; i < last; i++) v[i] = uniform_at(seed, i, min, max);
+            break;
+        case distribution::sorted:
+            for (auto i = first; i < last; i++) v[i] = sorted_at(seed, i, n, min, max);
+            break;
+        case distribution::reverse_sorted:
+            for (auto i = first; i < last; i++) v[i] = sorted_at(seed, n - 1 - i, n, min, max);
+            break;
+        case distribution::nearly_sorted:
+            for (auto i = first; i < last; i++) {
+                auto noisy = random_at(seed ^ SALT_NOISE, i) % 100 == 0;
+                v[i] = noisy ? uniform_at(seed, i, min, max) : sorted_at(seed, i, n, min, max);
+            }
+            break;
+        case distribution::few_unique:
+            for (auto i = first; i < last; i++) {
+                auto k = random_at(seed, i) % FEW_UNIQUE;
+                v[i] = uniform_at(seed ^ SALT_VALUES, k, min, max);
+            }
+            break;
+    }
+}
+
+}  // namespace detail
+
+/***
+ * Fill v with values in [min, max] shaped as dist, using nw threads on
+ * disjoint ranges (0 means one per hardware thread). The content depends
+ * only on the seed, not on nw.
+ */
+inline void random_fill(std::span<int> v, int min, int max, std::uint64_t seed,
+                        distribution dist = distribution::uniform, std::size_t nw = 0) {
+    // Below this size spawning threads costs more than filling the vector
+    constexpr std::size_t MIN_PER_THREAD = 1 << 16;
+
+    if (nw == 0) nw = std::max(1u, std::thread::hardware_concurrency());
+    nw = std::clamp<std::size_t>(v.size() / MIN_PER_THREAD, 1, nw);
+
+    auto ranges = block_partition(0, v.size(), nw);
+    auto fill = [&](const range &r) {
+        detail::fill_range(v.data(), r.first, r.second, v.size(), min, max, seed, dist);
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < nw; i++) threads.emplace_back(fill, ranges[i]);
+    fill(ranges[0]);
+    for (auto &t : threads) t.join();
+}
+
+}  // namespace spm
+
+#endif
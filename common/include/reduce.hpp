@@ -0,0 +1,189 @@
+#ifndef SPM_REDUCE_H
+#define SPM_REDUCE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "partitioner.hpp"
+#include "worker_team.hpp"
+
+namespace spm {
+
+/// Value alone in its cache line: per-thread accumulators written in a
+/// loop do not invalidate the lines of their neighbours.
+template <typename T>
+struct alignas(64) padded {
+    T value;
+};
+
+/// Whether op(a, b) == op(b, a), which lets the sequential loops split the
+/// work in independent lanes the compiler can vectorize. Specialize it for
+/// other commutative operators.
+template <typename Op>
+struct is_commutative : std::false_type {};
+
+template <typename T>
+struct is_commutative<std::plus<T>> : std::true_type {};
+template <typename T>
+struct is_commutative<std::multiplies<T>> : std::true_type {};
+template <typename T>
+struct is_commutative<std::bit_and<T>> : std::true_type {};
+template <typename T>
+struct is_commutative<std::bit_or<T>> : std::true_type {};
+template <typename T>
+struct is_commutative<std::bit_xor<T>> : std::true_type {};
+
+namespace detail {
+
+/// Sequential reduction of map(i) for i in [first, last), starting from init.
+template <typename T, typename Map, typename Op>
+T reduce_range(std::size_t first, std::size_t last, T init, Map &map, Op &op) {
+    if constexpr (std::is_arithmetic_v<T> && is_commutative<Op>::value) {
+        // Independent lanes: no loop carried dependency on a single accumulator
+        constexpr std::size_t LANES = 8;
+        auto i = first;
+        if (last - first >= LANES) {
+            T lanes[LANES];
+            for (std::size_t l = 0; l < LANES; l++) lanes[l] = map(i + l);
+            for (i += LANES; i + LANES <= last; i += LANES) {
+                for (std::size_t l = 0; l < LANES; l++) lanes[l] = op(lanes[l], map(i + l));
+            }
+            for (auto l : lanes) init = op(init, l);
+        }
+        for (; i < last; i++) init = op(init, map(i));
+        return init;
+    } else {
+        for (auto i = first; i < last; i++) init = op(init, map(i));
+        return init;
+    }
+}
+
+/// Combine the partials of the members in log2(nw) rounds, pairing
+/// neighbours so that only associativity is required. The result is in
+/// partials[0].
+template <typename T, typename Op>
+void tree_combine(std::vector<padded<T>> &partials, std::size_t id, worker_team &team, Op &op) {
+    auto nw = partials.size();
+    for (std::size_t stride = 1; stride < nw; stride *= 2) {
+        team.sync();
+        if (id % (2 * stride) == 0 && id + stride < nw) {
+            partials[id].value = op(partials[id].value, partials[id + stride].value);
+        }
+    }
+}
+
+}  // namespace detail
+
+/***
+ * Reduce map(i) for i in [first, last) with the associative op, starting
+ * from identity, on a static block per member of the team. Each member
+ * accumulates in its own padded slot, then the slots are combined as a tree.
+ */
+template <typename T, typename Map, typename Op = std::plus<T>>
+T map_reduce(worker_team &team, std::size_t first, std::size_t last, T identity, Map map,
+             Op op = {}) {
+    auto blocks = block_partition(first, std::max(first, last), team.size());
+    std::vector<padded<T>> partials(team.size(), padded<T>{identity});
+
+    team.run([&](std::size_t id) {
+        partials[id].value =
+            detail::reduce_range(blocks[id].first, blocks[id].second, identity, map, op);
+        detail::tree_combine(partials, id, team, op);
+    });
+
+    return partials[0].value;
+}
+
+/// Reduce map(x) for the elements x of in.
+template <typename T, typename In, typename Map, typename Op = std::plus<T>>
+T map_reduce(worker_team &team, std::span<const In> in, T identity, Map map, Op op = {}) {
+    return map_reduce(
+        team, 0, in.size(), identity, [&](std::size_t i) { return map(in[i]); }, op);
+}
+
+/// Reduce the elements of in.
+template <typename T, typename Op = std::plus<T>>
+T reduce(worker_team &team, std::span<const T> in, T identity, Op op = {}) {
+    return map_reduce(
+        team, 0, in.size(), identity, [&](std::size_t i) { return in[i]; }, op);
+}
+
+namespace detail {
+
+/***
+ * Three phase scan: each member reduces its block, the prefixes of the
+ * block sums are computed (nw values, by member 0), then each member scans
+ * its block starting from the prefix of the previous blocks. in and out
+ * may be the same span.
+ */
+template <typename T, typename Op>
+void scan(worker_team &team, std::span<const T> in, std::span<T> out, std::optional<T> init,
+          bool inclusive, Op &op) {
+    auto n = std::min(in.size(), out.size());
+    auto nw = team.size();
+    auto blocks = block_partition(0, n, nw);
+
+    // Sum of each block (empty blocks have none), then the carry into it
+    std::vector<padded<std::optional<T>>> carries(nw);
+
+    team.run([&](std::size_t id) {
+        auto [first, last] = blocks[id];
+        if (first < last) {
+            auto element = [&](std::size_t i) { return in[i]; };
+            carries[id].value = reduce_range(first + 1, last, in[first], element, op);
+        }
+        team.sync();
+
+        if (id == 0) {
+            auto running = init;
+            for (auto &c : carries) {
+                auto sum = c.value;
+                c.value = running;
+                if (sum) running = running ? op(*running, *sum) : *sum;
+            }
+        }
+        team.sync();
+
+        if (first == last) return;
+        const auto &carry = carries[id].value;
+        if (inclusive) {
+            auto running = carry ? op(*carry, in[first]) : in[first];
+            out[first] = running;
+            for (auto i = first + 1; i < last; i++) {
+                running = op(running, in[i]);
+                out[i] = running;
+            }
+        } else {
+            auto running = *carry;
+            for (auto i = first; i < last; i++) {
+                auto x = in[i];
+                out[i] = running;
+                running = op(running, x);
+            }
+        }
+    });
+}
+
+}  // namespace detail
+
+/// out[i] = in[0] op ... op in[i].
+template <typename T, typename Op = std::plus<T>>
+void inclusive_scan(worker_team &team, std::span<const T> in, std::span<T> out, Op op = {}) {
+    detail::scan(team, in, out, std::optional<T>{}, true, op);
+}
+
+/// out[i] = init op in[0] op ... op in[i - 1], out[0] = init.
+template <typename T, typename Op = std::plus<T>>
+void exclusive_scan(worker_team &team, std::span<const T> in, std::span<T> out, T init,
+                    Op op = {}) {
+    detail::scan(team, in, out, std::optional<T>{init}, false, op);
+}
+
+}  // namespace spm
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef SPM_SCALABILITY_H
+#define SPM_SCALABILITY_H
+
+#include <concepts>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "test_suite.hpp"
+
+namespace spm {
+
+/// Strong scaling keeps the problem size fixed, weak scaling grows it with nw.
+enum class scaling { strong, weak };
+
+inline const char *to_string(scaling mode) noexcept {
+    return mode == scaling::strong ? "strong" : "weak";
+}
+
+struct sweep_options {
+    /// Parallel degrees 1, 2, ..., max_nw
+    int max_nw = 1;
+    /// Problem size of strong scaling. Weak scaling gives size / max_nw to
+    /// each worker, so both end on the same problem (and memory) at max_nw
+    std::size_t size = 0;
+    bool strong = true;
+    bool weak = true;
+};
+
+/// Parse the --scaling value of the programs: strong, weak or both.
+inline std::optional<sweep_options> parse_scaling(std::string_view name) noexcept {
+    sweep_options opts;
+    if (name == "strong") opts.weak = false;
+    else if (name == "weak") opts.strong = false;
+    else if (name != "both") return std::nullopt;
+    return opts;
+}
+
+struct scaling_point {
+    scaling mode;
+    int nw;
+    std::size_t size;
+    /// Median times in microseconds of the sequential and the parallel version
+    double seq_us;
+    double par_us;
+    /// seq / par: the scaled speedup for weak scaling
+    double speedup;
+    /// speedup / nw
+    double efficiency;
+    /// par(1) / par(nw): for weak scaling it compares the problem of one
+    /// worker with nw times it, 1 being perfect
+    double scalability;
+};
+
+/***
+ * Results of a scalability sweep, with the serial fraction of the program
+ * fitted (least squares) on Amdahl's law from the strong scaling speedups,
+ * S(p) = 1 / (s + (1 - s) / p), and on Gustafson's law from the weak ones,
+ * S(p) = p - s (p - 1).
+ */
+class scalability_report {
+    std::string name;
+    std::vector<scaling_point> rows;
+
+   public:
+    explicit scalability_report(std::string name) : name(std::move(name)) {}
+
+    void add(const scaling_point &p) { rows.push_back(p); }
+
+    const std::vector<scaling_point> &points() const noexcept { return rows; }
+
+    /// Serial fraction according to Amdahl's law (nullopt without strong points).
+    std::optional<double> amdahl_serial_fraction() const {
+        // 1/S - 1/p = s (1 - 1/p)
+        double xy = 0, xx = 0;
+        for (const auto &r : rows) {
+            if (r.mode != scaling::strong || r.nw < 2) continue;
+            auto p = static_cast<double>(r.nw);
+            auto x = 1 - 1 / p;
+            xy += x * (1 / r.speedup - 1 / p);
+            xx += x * x;
+        }
+        if (xx == 0) return std::nullopt;
+        return xy / xx;
+    }
+
+    /// Serial fraction according to Gustafson's law (nullopt without weak points).
+    std::optional<double> gustafson_serial_fraction() const {
+        // p - S = s (p - 1)
+        double xy = 0, xx = 0;
+        for (const auto &r : rows) {
+            if (r.mode != scaling::weak || r.nw < 2) continue;
+            auto x = static_cast<double>(r.nw - 1);
+            xy += x * (r.nw - r.speedup);
+            xx += x * x;
+        }
+        if (xx == 0) return std::nullopt;
+        return xy / xx;
+    }
+
+    void print(std::FILE *out = stdout) const {
+        std::fprintf(out, "%s\n%-8s %4s %12s %14s %14s %9s %11s %12s\n", name.c_str(), "scaling",
+                     "nw", "size", "seq (μs)", "par (μs)", "speedup", "efficiency",
+                     "scalability");
+        for (const auto &r : rows) {
+            std::fprintf(out, "%-8s %4d %12zu %14.2f %14.2f %9.2f %11.2f %12.2f\n",
+                         to_string(r.mode), r.nw, r.size, r.seq_us, r.par_us, r.speedup,
+                         r.efficiency, r.scalability);
+        }
+
+        if (auto s = amdahl_serial_fraction()) {
+            std::fprintf(out, "Amdahl serial fraction: %.4f (speedup bound %.2f)\n", *s,
+                         *s > 0 ? 1 / *s : 0.0);
+        }
+        if (auto s = gustafson_serial_fraction()) {
+            std::fprintf(out, "Gustafson serial fraction: %.4f\n", *s);
+        }
+    }
+
+    /// One row per point, ready to plot.
+    bool write_csv(const std::string &path) const {
+        auto *file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+
+        std::fprintf(file, "name,scaling,nw,size,seq_us,par_us,speedup,efficiency,scalability\n");
+        for (const auto &r : rows) {
+            std::fprintf(file, "%s,%s,%d,%zu,%.3f,%.3f,%.4f,%.4f,%.4f\n", name.c_str(),
+                         to_string(r.mode), r.nw, r.size, r.seq_us, r.par_us, r.speedup,
+                         r.efficiency, r.scalability);
+        }
+
+        return std::fclose(file) == 0;
+    }
+};
+
+/***
+ * Run a strong and/or weak scalability sweep for nw = 1, ..., max_nw.
+ * measure(size, nw) times the program on a problem of the given size and
+ * returns its stats (see test_suite); nw == 0 asks for the sequential
+ * version. Medians are used, being robust to outliers.
+ */
+template <typename Measure>
+    requires std::invocable<Measure &, std::size_t, int>
+scalability_report scalability_sweep(std::string name, const sweep_options &opts,
+                                     Measure &&measure) {
+    scalability_report report(std::move(name));
+
+    auto point = [](scaling mode, int nw, std::size_t size, double seq, double par,
+                    double base) {
+        auto speedup = seq / par;
+        return scaling_point{mode, nw, size, seq, par, speedup, speedup / nw, base / par};
+    };
+
+    if (opts.strong) {
+        auto seq = measure(opts.size, 0).median;
+        double base = 0;
+        for (int nw = 1; nw <= opts.max_nw; nw++) {
+            auto par = measure(opts.size, nw).median;
+            if (nw == 1) base = par;
+            report.add(point(scaling::strong, nw, opts.size, seq, par, base));
+        }
+    }
+
+    if (opts.weak) {
+        auto per_worker = opts.size / static_cast<std::size_t>(opts.max_nw);
+        double base = 0;
+        for (int nw = 1; nw <= opts.max_nw; nw++) {
+            auto size = per_worker * static_cast<std::size_t>(nw);
+            auto seq = measure(size, 0).median;
+            auto par = measure(size, nw).median;
+            if (nw == 1) base = par;
+            report.add(point(scaling::weak, nw, size, seq, par, base));
+        }
+    }
+
+    return report;
+}
+
+}  // namespace spm
+
+#endif
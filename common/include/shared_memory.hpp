@@ -0,0 +1,136 @@
+#ifndef SPM_SHARED_MEMORY_H
+#define SPM_SHARED_MEMORY_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace spm {
+
+/***
+ * POSIX shared memory object (shm_open) mapped in the address space. The
+ * creator removes the name when it is destroyed; the processes forked in
+ * the meantime keep the mapping, and other ones can attach by name while
+ * it exists. Lock-free std::atomic objects placed in it are shared between
+ * the processes too.
+ */
+class shared_region {
+    std::string name;
+    void *data = MAP_FAILED;
+    std::size_t bytes = 0;
+    bool owner = false;
+
+    void map(int fd) {
+        if (fd < 0) return;
+        if (bytes > 0) data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+    }
+
+   public:
+    /// Create the object name (e.g. "/spm_primes") of the given size, zero filled.
+    shared_region(std::string name, std::size_t bytes)
+        : name(std::move(name)), bytes(bytes), owner(true) {
+        int fd = ::shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd >= 0 && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        if (fd < 0) {
+            owner = false;
+            return;
+        }
+        map(fd);
+    }
+
+    /// Attach to the existing object name.
+    explicit shared_region(std::string name) : name(std::move(name)) {
+        int fd = ::shm_open(this->name.c_str(), O_RDWR, 0);
+        struct stat st;
+        if (fd >= 0 && ::fstat(fd, &st) == 0) bytes = static_cast<std::size_t>(st.st_size);
+        map(fd);
+    }
+
+    ~shared_region() {
+        if (data != MAP_FAILED) ::munmap(data, bytes);
+        if (owner) ::shm_unlink(name.c_str());
+    }
+
+    shared_region(const shared_region &) = delete;
+    shared_region &operator=(const shared_region &) = delete;
+
+    /// Remove the name now: the mapping stays valid, and is inherited by
+    /// the forked processes, but is not left behind if the process is killed.
+    void unlink() noexcept {
+        if (owner) ::shm_unlink(name.c_str());
+        owner = false;
+    }
+
+    bool ok() const noexcept { return data != MAP_FAILED; }
+    std::size_t size() const noexcept { return bytes; }
+    const std::string &path() const noexcept { return name; }
+
+    template <typename T>
+    T *as(std::size_t offset = 0) const noexcept {
+        return reinterpret_cast<T *>(static_cast<char *>(data) + offset);
+    }
+};
+
+/// How a child process ended.
+struct process_status {
+    pid_t pid = -1;
+    /// Exit code, -1 if killed by a signal or never started
+    int exit_code = -1;
+    /// Signal that killed the process, 0 if none
+    int signal = 0;
+
+    bool ok() const noexcept { return exit_code == 0; }
+};
+
+/***
+ * Fork n processes running f(i) for i in [0, n), whose return value is
+ * the exit code, and wait for all of them. A process crashing does not
+ * affect the others: its status tells the signal that killed it. Fork
+ * before starting threads, only the calling thread exists in the children.
+ */
+template <typename Fun>
+std::vector<process_status> run_processes(std::size_t n, Fun &&f) {
+    std::vector<process_status> statuses(n);
+
+    // Buffered output would be written again by each child
+    std::fflush(nullptr);
+
+    for (std::size_t i = 0; i < n; i++) {
+        auto pid = ::fork();
+        if (pid == 0) {
+            int code = f(i);
+            std::fflush(nullptr);
+            ::_exit(code);
+        }
+        statuses[i].pid = pid;
+    }
+
+    for (auto &s : statuses) {
+        if (s.pid < 0) continue;
+        int status = 0;
+        pid_t done;
+        while ((done = ::waitpid(s.pid, &status, 0)) < 0 && errno == EINTR) {
+        }
+        if (done < 0) continue;
+        if (WIFEXITED(status)) s.exit_code = WEXITSTATUS(status);
+        if (WIFSIGNALED(status)) s.signal = WTERMSIG(status);
+    }
+    return statuses;
+}
+
+}  // namespace spm
+
+#endif
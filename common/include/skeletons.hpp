@@ -0,0 +1,247 @@
+#ifndef SPM_SKELETONS_H
+#define SPM_SKELETONS_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "unbounded_queue.hpp"
+
+namespace spm {
+
+/// Stream of T items between two stages. The empty item (std::nullopt)
+/// signals the end of the stream (EOS), as the poison pill of the threadpool.
+template <typename T>
+using channel = unbounded_queue<std::optional<T>>;
+
+/// How the farm emitter hands out the items to the workers.
+///  - on_demand:   a shared queue, the first idle worker takes the next item
+///  - round_robin: one queue per worker, items are assigned cyclically
+enum class dispatch { on_demand, round_robin };
+
+namespace detail {
+
+template <typename T>
+struct unwrap_optional {
+    using type = T;
+};
+
+template <typename T>
+struct unwrap_optional<std::optional<T>> {
+    using type = T;
+};
+
+template <typename T>
+using unwrap_optional_t = typename unwrap_optional<T>::type;
+
+/// Adapt a function returning either Out or std::optional<Out> (where
+/// std::nullopt filters the item out) to a function returning std::optional<Out>.
+template <typename In, typename Out, typename F>
+std::function<std::optional<Out>(In)> as_filter(F &&f) {
+    return [f = std::forward<F>(f)](In item) mutable -> std::optional<Out> {
+        return f(std::move(item));
+    };
+}
+
+}  // namespace detail
+
+/***
+ * Farm skeleton: an emitter dispatching the input stream to nw workers and a
+ * collector gathering their results. With ordering enabled the collector
+ * restores the input order through a reorder buffer. It can run alone,
+ * through run(), or as a stage of spm::pipeline.
+ */
+template <typename In, typename Out>
+class farm {
+    /// An item along with its position in the input stream.
+    template <typename T>
+    using tagged = std::pair<std::size_t, T>;
+
+    std::size_t nw;
+    std::function<std::optional<Out>(In)> worker;
+    dispatch policy;
+    bool ordered;
+    std::function<void()> init;
+
+   public:
+    using input_type = In;
+    using output_type = Out;
+
+    template <typename F>
+    farm(std::size_t nw, F &&worker, dispatch policy = dispatch::on_demand,
+         bool ordered = false)
+        : nw{std::max<std::size_t>(nw, 1)},
+          worker{detail::as_filter<In, Out>(std::forward<F>(worker))},
+          policy{policy},
+          ordered{ordered} {}
+
+    /// Run f in each worker thread before its first item, e.g. to build
+    /// thread local state out of the service time of the tasks.
+    template <typename F>
+    farm &on_worker_start(F &&f) {
+        init = std::forward<F>(f);
+        return *this;
+    }
+
+    /// Spawn emitter, workers and collector, connected to the given channels.
+    void start(std::shared_ptr<channel<In>> in, std::shared_ptr<channel<Out>> out,
+               std::vector<std::thread> &threads) const {
+        auto queues_count = (policy == dispatch::round_robin) ? nw : 1;
+
+        std::vector<std::shared_ptr<channel<tagged<In>>>> to_workers;
+        for (std::size_t i = 0; i < queues_count; i++)
+            to_workers.push_back(std::make_shared<channel<tagged<In>>>());
+
+        auto to_collector = std::make_shared<channel<tagged<std::optional<Out>>>>();
+
+        // Emitter
+        threads.emplace_back([in, to_workers, nw = nw]() {
+            std::size_t seq = 0;
+            while (auto item = in->dequeue()) {
+                auto &queue = to_workers[seq % to_workers.size()];
+                queue->enqueue(tagged<In>{seq++, std::move(*item)});
+            }
+            // Propagate the EOS: one for each worker
+            for (std::size_t i = 0; i < nw; i++)
+                to_workers[i % to_workers.size()]->enqueue(std::nullopt);
+        });
+
+        // Workers
+        for (std::size_t i = 0; i < nw; i++) {
+            auto queue = to_workers[i % to_workers.size()];
+            threads.emplace_back([queue, to_collector, f = worker, init = init,
+                                  ordered = ordered]() mutable {
+                if (init) init();
+                while (auto item = queue->dequeue()) {
+                    auto result = f(std::move(item->second));
+                    // Filtered items still move the reorder buffer forward
+                    if (result || ordered)
+                        to_collector->enqueue(
+                            tagged<std::optional<Out>>{item->first, std::move(result)});
+                }
+                to_collector->enqueue(std::nullopt);
+            });
+        }
+
+        // Collector
+        threads.emplace_back([to_collector, out, nw = nw, ordered = ordered]() {
+            std::size_t eos = 0;
+            std::size_t next = 0;
+            std::map<std::size_t, std::optional<Out>> reorder_buffer;
+
+            while (eos < nw) {
+                auto item = to_collector->dequeue();
+                if (!item) {
+                    eos++;
+                    continue;
+                }
+                if (!ordered) {
+                    out->enqueue(std::move(item->second));
+                    continue;
+                }
+
+                reorder_buffer.emplace(item->first, std::move(item->second));
+                for (auto it = reorder_buffer.begin();
+                     it != reorder_buffer.end() && it->first == next;
+                     it = reorder_buffer.erase(it), next++) {
+                    if (it->second) out->enqueue(std::move(it->second));
+                }
+            }
+            out->enqueue(std::nullopt);
+        });
+    }
+
+    template <typename Source, typename Sink>
+    void run(Source &&source, Sink &&sink) const;
+};
+
+namespace detail {
+
+template <typename Stage, typename In>
+struct stage_traits {
+    using output_type = unwrap_optional_t<std::invoke_result_t<Stage &, In>>;
+
+    static void start(Stage stage, std::shared_ptr<channel<In>> in,
+                      std::shared_ptr<channel<output_type>> out,
+                      std::vector<std::thread> &threads) {
+        auto f = as_filter<In, output_type>(std::move(stage));
+        threads.emplace_back([in, out, f]() mutable {
+            while (auto item = in->dequeue()) {
+                if (auto result = f(std::move(*item))) out->enqueue(std::move(result));
+            }
+            out->enqueue(std::nullopt);
+        });
+    }
+};
+
+template <typename In, typename Out>
+struct stage_traits<farm<In, Out>, In> {
+    using output_type = Out;
+
+    static void start(const farm<In, Out> &stage, std::shared_ptr<channel<In>> in,
+                      std::shared_ptr<channel<Out>> out,
+                      std::vector<std::thread> &threads) {
+        stage.start(std::move(in), std::move(out), threads);
+    }
+};
+
+template <typename In, typename Stage, typename... Stages>
+void connect(std::shared_ptr<channel<In>> in, std::vector<std::thread> &threads,
+             Stage &&stage, Stages &&...stages) {
+    if constexpr (sizeof...(Stages) == 0) {
+        // Last stage: the sink consumes the stream
+        threads.emplace_back([in, sink = std::forward<Stage>(stage)]() mutable {
+            while (auto item = in->dequeue()) sink(std::move(*item));
+        });
+    } else {
+        using traits = stage_traits<std::decay_t<Stage>, In>;
+        using Out = typename traits::output_type;
+
+        auto out = std::make_shared<channel<Out>>();
+        traits::start(std::forward<Stage>(stage), in, out, threads);
+        connect<Out>(out, threads, std::forward<Stages>(stages)...);
+    }
+}
+
+}  // namespace detail
+
+/***
+ * Pipeline skeleton: pipeline(source, stage_1, ..., stage_n, sink).
+ * The source returns the next item or std::nullopt at the end of the stream.
+ * Each stage is either a spm::farm or a function returning the result
+ * (std::nullopt drops the item). The sink consumes the final stream.
+ * Every stage runs on its own threads; the call returns once the EOS
+ * reached the sink.
+ */
+template <typename Source, typename... Stages>
+void pipeline(Source &&source, Stages &&...stages) {
+    static_assert(sizeof...(Stages) >= 1, "A pipeline needs at least a sink");
+
+    using T = detail::unwrap_optional_t<std::invoke_result_t<Source &>>;
+
+    std::vector<std::thread> threads;
+    auto first = std::make_shared<channel<T>>();
+
+    detail::connect<T>(first, threads, std::forward<Stages>(stages)...);
+
+    // The source runs in the calling thread
+    while (auto item = source()) first->enqueue(std::move(item));
+    first->enqueue(std::nullopt);
+
+    for (auto &t : threads) t.join();
+}
+
+template <typename In, typename Out>
+template <typename Source, typename Sink>
+void farm<In, Out>::run(Source &&source, Sink &&sink) const {
+    pipeline(std::forward<Source>(source), *this, std::forward<Sink>(sink));
+}
+
+}  // namespace spm
+
+#endif
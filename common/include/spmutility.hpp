@@ -6,6 +6,7 @@
 #include <chrono>
 #include <concepts>
 #include <condition_variable>
+#include <cstdint>
 #include <cstdio>
 #include <functional>
 #include <iostream>
@@ -16,8 +17,12 @@
 #include <utility>
 #include <vector>
 
+#include "random.hpp"
+
 #ifdef __APPLE__
     #include <sys/sysctl.h>
+#else
+    #include <unistd.h>
 #endif
 
 namespace spm {
@@ -41,8 +46,8 @@ concept Ord = Eq<T> && requires(T a, T b) {
  */
 class utimer {
     std::string message;
-    std::chrono::system_clock::time_point start;
-    std::chrono::system_clock::time_point stop;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point stop;
 
     using usecs = std::chrono::microseconds;
     using msecs = std::chrono::milliseconds;
@@ -52,16 +57,16 @@ class utimer {
 
    public:
     utimer(const std::string &&m) : message(std::move(m)), us_elapsed(nullptr) {
-        start = std::chrono::system_clock::now();
+        start = std::chrono::steady_clock::now();
     }
 
     utimer(const std::string &&m, long *us)
         : message(std::move(m)), us_elapsed(us) {
-        start = std::chrono::system_clock::now();
+        start = std::chrono::steady_clock::now();
     }
 
     ~utimer() {
-        stop = std::chrono::system_clock::now();
+        stop = std::chrono::steady_clock::now();
         std::chrono::duration<double> elapsed = stop - start;
         auto musec = std::chrono::duration_cast<usecs>(elapsed).count();
 
@@ -71,33 +76,42 @@ class utimer {
     }
 
     static double to_seconds(long musec) {
-        return static_cast<double>(musec) / 1000.0;
+        return static_cast<double>(musec) / 1'000'000.0;
     }
 };
 
-template <typename T>
-void swap(T &a, T &b) noexcept {
+/// Function object rather than a function template, so that it is never
+/// picked up by ADL when std algorithms swap objects of the spm namespace.
+inline constexpr auto swap = []<typename T>(T &a, T &b) noexcept {
     T temp = a;
     a = b;
     b = temp;
-}
-
-std::vector<int> gen_random_int_vector(std::size_t size, int min = 0,
-                                       int max = 1000) noexcept {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distrib(min, max);
+};
 
+/// Reproducible random vector: the same seed gives the same vector.
+std::vector<int> gen_random_int_vector(std::size_t size, int min, int max,
+                                       std::uint64_t seed,
+                                       distribution dist = distribution::uniform) {
     std::vector<int> v{};
     v.resize(size);
 
-    for (auto &vi : v) vi = distrib(gen);
+    random_fill(v, min, max, seed, dist);
 
     return v;
 }
 
+std::vector<int> gen_random_int_vector(std::size_t size, int min = 0,
+                                       int max = 1000) noexcept {
+    std::random_device rd;
+    auto seed = (static_cast<std::uint64_t>(rd()) << 32) | rd();
+
+    return gen_random_int_vector(size, min, max, seed);
+}
+
 double speedup(double seq_time, double par_time) { return seq_time / par_time; }
 
+/// Busy wait polling the clock. It models neither compute nor memory
+/// work: use the calibrated kernels of workload.hpp to fake a task.
 void active_delay(const std::chrono::nanoseconds& nsecs) {
 
   // read current time
@@ -119,9 +133,42 @@ std::size_t get_cache_line_size() {
     sysctlbyname("hw.cachelinesize", &line_size, &sizeof_line_size, 0, 0);
     return line_size;
 }
+
+/// Size in bytes of the last level cache.
+inline std::size_t get_llc_size() {
+    std::size_t size = 0;
+    std::size_t sizeof_size = sizeof(size);
+    if (sysctlbyname("hw.l3cachesize", &size, &sizeof_size, 0, 0) != 0 || size == 0)
+        sysctlbyname("hw.l2cachesize", &size, &sizeof_size, 0, 0);
+    return size > 0 ? size : 8 * 1024 * 1024;
+}
+
+/// Size in bytes of the physical memory.
+inline std::size_t get_physical_memory() {
+    std::uint64_t size = 0;
+    std::size_t sizeof_size = sizeof(size);
+    sysctlbyname("hw.memsize", &size, &sizeof_size, 0, 0);
+    return size > 0 ? static_cast<std::size_t>(size) : std::size_t{1} << 30;
+}
 #else
 std::size_t get_cache_line_size() {
-    return 0;
+    auto line_size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    return line_size > 0 ? static_cast<std::size_t>(line_size) : 64;
+}
+
+/// Size in bytes of the last level cache.
+inline std::size_t get_llc_size() {
+    auto size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? static_cast<std::size_t>(size) : 8 * 1024 * 1024;
+}
+
+/// Size in bytes of the physical memory.
+inline std::size_t get_physical_memory() {
+    auto pages = sysconf(_SC_PHYS_PAGES);
+    auto page = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page <= 0) return std::size_t{1} << 30;
+    return static_cast<std::size_t>(pages) * static_cast<std::size_t>(page);
 }
 #endif
 
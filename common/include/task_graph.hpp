@@ -0,0 +1,147 @@
+#ifndef SPM_TASK_GRAPH_H
+#define SPM_TASK_GRAPH_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "threadpool.hpp"
+
+namespace spm {
+
+/***
+ * Graph of tasks with dependencies (a DAG), declared once and run any
+ * number of times on a threadpool. Each run gives every node an atomic
+ * counter of unfinished predecessors: the node finishing last makes its
+ * successor ready, with no central scheduler. The ready successors of a
+ * node run on the same worker as long as there are any, the first one
+ * directly (its inputs are still in that core's cache) and the others
+ * submitted to the pool. run() waits for all the nodes.
+ * A graph cannot be modified nor run again while it is running.
+ */
+class task_graph {
+   public:
+    using node_id = std::size_t;
+
+   private:
+    struct node {
+        std::function<void()> work;
+        std::string name;
+        std::vector<node_id> successors;
+        std::size_t predecessors = 0;
+    };
+
+    /// State of a run, shared by its tasks: the last one may still be
+    /// returning when run() wakes up.
+    struct run_state {
+        std::vector<std::atomic<std::size_t>> pending;
+        std::atomic<std::size_t> remaining;
+        spm::future<bool> done;
+
+        explicit run_state(std::size_t nodes) : pending(nodes), remaining(nodes) {}
+    };
+
+    std::vector<node> nodes;
+    /// Known to be acyclic since the last change
+    bool checked = false;
+
+    /// Run id and then its ready successors, one after the other.
+    void execute(threadpool &pool, const std::shared_ptr<run_state> &state, node_id id) const {
+        while (true) {
+            nodes[id].work();
+
+            node_id next = nodes.size();
+            for (auto s : nodes[id].successors) {
+                if (state->pending[s].fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+                if (next == nodes.size()) {
+                    next = s;
+                } else {
+                    pool.execute([this, &pool, state, s]() { execute(pool, state, s); });
+                }
+            }
+
+            // Once its node is counted the graph can be gone: decide before
+            auto last = (next == nodes.size());
+            if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                state->done.put(true);
+                return;
+            }
+            if (last) return;
+            id = next;
+        }
+    }
+
+   public:
+    /// Add a node running work, named for the diagnostics.
+    node_id add(std::function<void()> work, std::string name = {}) {
+        nodes.push_back(node{std::move(work), std::move(name), {}, 0});
+        return nodes.size() - 1;
+    }
+
+    /// Make after wait for before.
+    void precede(node_id before, node_id after) {
+        nodes[before].successors.push_back(after);
+        nodes[after].predecessors++;
+        checked = false;
+    }
+
+    std::size_t size() const noexcept { return nodes.size(); }
+
+    const std::string &name(node_id id) const { return nodes[id].name; }
+
+    /// Whether the dependencies have no cycles (which would never run).
+    bool acyclic() {
+        if (checked) return true;
+
+        // Kahn: repeatedly remove the nodes without predecessors left
+        std::vector<std::size_t> in(nodes.size());
+        std::vector<node_id> ready;
+        for (node_id i = 0; i < nodes.size(); i++) {
+            in[i] = nodes[i].predecessors;
+            if (in[i] == 0) ready.push_back(i);
+        }
+        std::size_t removed = 0;
+        while (!ready.empty()) {
+            auto id = ready.back();
+            ready.pop_back();
+            removed++;
+            for (auto s : nodes[id].successors) {
+                if (--in[s] == 0) ready.push_back(s);
+            }
+        }
+
+        checked = (removed == nodes.size());
+        return checked;
+    }
+
+    /***
+     * Run the graph on the pool and wait for it. Returns false, running
+     * nothing, if it has a cycle. The calling thread must not be a worker
+     * of the pool.
+     */
+    bool run(threadpool &pool) {
+        if (!acyclic()) return false;
+        if (nodes.empty()) return true;
+
+        auto state = std::make_shared<run_state>(nodes.size());
+        std::vector<node_id> sources;
+        for (node_id i = 0; i < nodes.size(); i++) {
+            state->pending[i].store(nodes[i].predecessors, std::memory_order_relaxed);
+            if (nodes[i].predecessors == 0) sources.push_back(i);
+        }
+
+        for (auto id : sources) {
+            pool.execute([this, &pool, state, id]() { execute(pool, state, id); });
+        }
+
+        return state->done.get();
+    }
+};
+
+}  // namespace spm
+
+#endif
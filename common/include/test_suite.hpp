@@ -0,0 +1,265 @@
+#ifndef SPM_TEST_SUITE_H
+#define SPM_TEST_SUITE_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace spm {
+
+/// Statistics of the repetitions of a benchmark, times in microseconds.
+struct stats {
+    // how many tests have been performed
+    int iterations = 0;
+    double min = 0;
+    double max = 0;
+    double average = 0;
+    double median = 0;
+    double stddev = 0;
+    /// Confidence interval of the average
+    double ci_low = 0;
+    double ci_high = 0;
+
+    std::vector<double> samples{};
+};
+
+struct suite_options {
+    /// Untimed runs before the measured ones (caches, page faults, turbo...)
+    int warmup = 1;
+    /// Number of repetitions; the minimum one when adaptive
+    int iterations = 10;
+    /// Repeat until the confidence interval is narrower than precision * average
+    bool adaptive = false;
+    int max_iterations = 1000;
+    double precision = 0.02;
+    /// Confidence level of the interval: 0.90, 0.95 or 0.99
+    double confidence = 0.95;
+};
+
+namespace detail {
+
+/// Two-sided quantile of the standard normal distribution for the usual levels.
+inline double normal_quantile(double confidence) {
+    if (confidence >= 0.99) return 2.5758;
+    if (confidence >= 0.95) return 1.9600;
+    return 1.6449;
+}
+
+/// Two-sided quantile of Student's t distribution with dof degrees of freedom:
+/// tabulated up to 30, where the Cornish-Fisher expansion around the normal
+/// quantile is poor (9.7 instead of 12.71 at dof = 1 and 95%), expanded above.
+inline double t_quantile(double confidence, int dof) {
+    static constexpr std::array<double, 30> t90 = {
+        6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+        1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+        1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697};
+    static constexpr std::array<double, 30> t95 = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    static constexpr std::array<double, 30> t99 = {
+        63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+        3.106,  3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+        2.831,  2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750};
+
+    auto z = normal_quantile(confidence);
+    if (dof <= 0) return z;
+
+    if (dof <= 30) {
+        // The same levels as normal_quantile
+        const auto &table = (confidence >= 0.99) ? t99 : (confidence >= 0.95) ? t95 : t90;
+        return table[static_cast<std::size_t>(dof - 1)];
+    }
+
+    auto v = static_cast<double>(dof);
+    auto z3 = z * z * z, z5 = z3 * z * z, z7 = z5 * z * z;
+    return z + (z3 + z) / (4 * v) + (5 * z5 + 16 * z3 + 3 * z) / (96 * v * v) +
+           (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * v * v * v);
+}
+
+inline stats compute_stats(std::vector<double> samples, double confidence) {
+    stats s;
+    s.iterations = static_cast<int>(samples.size());
+    if (samples.empty()) return s;
+
+    auto n = static_cast<double>(samples.size());
+    s.average = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+
+    double sq = 0;
+    for (auto x : samples) sq += (x - s.average) * (x - s.average);
+    s.stddev = (samples.size() > 1) ? std::sqrt(sq / (n - 1)) : 0.0;
+
+    auto half = t_quantile(confidence, s.iterations - 1) * s.stddev / std::sqrt(n);
+    s.ci_low = s.average - half;
+    s.ci_high = s.average + half;
+
+    s.samples = samples;
+    std::sort(samples.begin(), samples.end());
+    s.min = samples.front();
+    s.max = samples.back();
+    auto mid = samples.size() / 2;
+    s.median = (samples.size() % 2) ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+
+    return s;
+}
+
+template <typename Fun>
+double time_us(Fun &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(stop - start).count();
+}
+
+}  // namespace detail
+
+/***
+ * Measure f: warmup runs, then a fixed number of repetitions (at least
+ * one) or, when adaptive, as many as needed to reach the requested precision.
+ * setup() runs untimed before each repetition (e.g. to restore the input
+ * of an in place sort).
+ */
+template <typename Setup, typename Fun>
+stats test_suite(const suite_options &opts, Setup &&setup, Fun &&f) {
+    for (int i = 0; i < opts.warmup; i++) {
+        setup();
+        f();
+    }
+
+    // Stats over no samples would be all zeros: take at least one
+    auto iterations = std::max(opts.iterations, 1);
+
+    std::vector<double> samples;
+    auto enough = [&]() {
+        auto n = static_cast<int>(samples.size());
+        if (n < std::max(iterations, 2)) return n >= iterations;
+        if (!opts.adaptive || n >= opts.max_iterations) return true;
+
+        auto s = detail::compute_stats(samples, opts.confidence);
+        return (s.ci_high - s.ci_low) / 2 <= opts.precision * s.average;
+    };
+
+    while (!enough()) {
+        setup();
+        samples.push_back(detail::time_us(f));
+    }
+
+    return detail::compute_stats(std::move(samples), opts.confidence);
+}
+
+template <typename Fun>
+stats test_suite(const suite_options &opts, Fun &&f) {
+    return test_suite(opts, []() {}, std::forward<Fun>(f));
+}
+
+template <typename Fun, typename... Args>
+stats test_suite(int iterations, Fun &&f, Args &&...args) {
+    suite_options opts;
+    opts.iterations = iterations;
+    return test_suite(opts, [&]() { std::invoke(f, args...); });
+}
+
+/***
+ * Collects the stats of several benchmarks (e.g. a parameter sweep) and
+ * exports them as a table, as CSV or as JSON.
+ */
+class benchmark_report {
+    using params = std::vector<std::pair<std::string, std::string>>;
+
+    struct row {
+        std::string name;
+        params parameters;
+        stats result;
+    };
+
+    std::vector<row> rows;
+
+   public:
+    void add(std::string name, params parameters, stats result) {
+        rows.push_back({std::move(name), std::move(parameters), std::move(result)});
+    }
+
+    /// Run make(value) for each value and measure the function it returns.
+    template <typename T, typename Make>
+    void sweep(const std::string &name, const std::string &param,
+               const std::vector<T> &values, const suite_options &opts, Make &&make) {
+        for (const auto &value : values) {
+            auto f = make(value);
+            add(name, {{param, std::to_string(value)}}, test_suite(opts, f));
+        }
+    }
+
+    const std::vector<row> &results() const noexcept { return rows; }
+
+    void print(std::FILE *out = stdout) const {
+        for (const auto &r : rows) {
+            std::fprintf(out, "%s", r.name.c_str());
+            for (const auto &[k, v] : r.parameters) std::fprintf(out, " %s=%s", k.c_str(), v.c_str());
+            std::fprintf(out,
+                         ": median %.2f μs, mean %.2f μs ± %.2f (CI [%.2f, %.2f]), "
+                         "min %.2f, max %.2f, %d runs\n",
+                         r.result.median, r.result.average, r.result.stddev, r.result.ci_low,
+                         r.result.ci_high, r.result.min, r.result.max, r.result.iterations);
+        }
+    }
+
+    bool write_csv(const std::string &path) const {
+        auto *file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+
+        std::fprintf(file, "name,params,iterations,min_us,max_us,mean_us,median_us,stddev_us,"
+                           "ci_low_us,ci_high_us\n");
+        for (const auto &r : rows) {
+            std::string p;
+            for (const auto &[k, v] : r.parameters) p += (p.empty() ? "" : ";") + k + "=" + v;
+            std::fprintf(file, "%s,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", r.name.c_str(),
+                         p.c_str(), r.result.iterations, r.result.min, r.result.max,
+                         r.result.average, r.result.median, r.result.stddev, r.result.ci_low,
+                         r.result.ci_high);
+        }
+
+        return std::fclose(file) == 0;
+    }
+
+    bool write_json(const std::string &path) const {
+        auto *file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+
+        std::fprintf(file, "[\n");
+        for (std::size_t i = 0; i < rows.size(); i++) {
+            const auto &r = rows[i];
+            std::fprintf(file, "  {\"name\": \"%s\", \"params\": {", r.name.c_str());
+            for (std::size_t j = 0; j < r.parameters.size(); j++) {
+                std::fprintf(file, "%s\"%s\": \"%s\"", j ? ", " : "",
+                             r.parameters[j].first.c_str(), r.parameters[j].second.c_str());
+            }
+            std::fprintf(file,
+                         "}, \"iterations\": %d, \"min_us\": %.3f, \"max_us\": %.3f, "
+                         "\"mean_us\": %.3f, \"median_us\": %.3f, \"stddev_us\": %.3f, "
+                         "\"ci_us\": [%.3f, %.3f]}%s\n",
+                         r.result.iterations, r.result.min, r.result.max, r.result.average,
+                         r.result.median, r.result.stddev, r.result.ci_low, r.result.ci_high,
+                         (i + 1 < rows.size()) ? "," : "");
+        }
+        std::fprintf(file, "]\n");
+
+        return std::fclose(file) == 0;
+    }
+
+    /// Write CSV or JSON depending on the extension of path.
+    bool write(const std::string &path) const {
+        auto json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        return json ? write_json(path) : write_csv(path);
+    }
+};
+
+}  // namespace spm
+
+#endif
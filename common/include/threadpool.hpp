@@ -0,0 +1,380 @@
+#ifndef SPM_THREADPOOL_H
+#define SPM_THREADPOOL_H
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <optional>
+
+#include "histogram.hpp"
+#include "spmutility.hpp"
+#include "unbounded_queue.hpp"
+
+namespace spm {
+
+template <typename Out>
+class future {
+    std::optional<Out> value{};
+    std::mutex future_lock;
+    std::condition_variable future_cv;
+
+   public:
+    void put(Out val) {
+        std::lock_guard<std::mutex> lock(future_lock);
+        this->value = std::optional{val};
+        future_cv.notify_all();
+    }
+
+    Out &get() {
+        std::unique_lock<std::mutex> lock(future_lock);
+
+        if (value.has_value()) {
+            return *this->value;
+        }
+
+        // Wait until the queue is not empty
+        future_cv.wait(lock, [&]() { return this->value.has_value(); });
+
+        return *this->value;
+    }
+};
+
+/***
+ * Bounds of an elastic threadpool. The pool starts min_workers workers and
+ * adds one (up to max_workers) when a submission finds more than
+ * max_queue_depth tasks queued, or when a worker dequeues a task that
+ * waited longer than max_queue_wait and others are still queued. A worker
+ * idle for idle_timeout retires, as long as min_workers remain.
+ */
+struct elastic_options {
+    unsigned int min_workers = 1;
+    unsigned int max_workers = std::thread::hardware_concurrency();
+    std::size_t max_queue_depth = 64;
+    std::chrono::microseconds max_queue_wait{1000};
+    std::chrono::milliseconds idle_timeout{500};
+};
+
+/// Counters of a single worker of the pool.
+struct worker_stats {
+    unsigned int id = 0;
+    bool retired = false;
+    std::uint64_t completed = 0;
+    /// Time spent running tasks and waiting for them (ns)
+    std::uint64_t busy_ns = 0;
+    std::uint64_t idle_ns = 0;
+
+    double utilization() const noexcept {
+        auto total = busy_ns + idle_ns;
+        return total ? static_cast<double>(busy_ns) / static_cast<double>(total) : 0.0;
+    }
+};
+
+/***
+ * Snapshot of the runtime metrics of a threadpool. The pool has a single
+ * shared queue (no work stealing), so its saturation shows as growing
+ * queue depth and wait times with every worker close to full utilization.
+ */
+struct threadpool_metrics {
+    std::uint64_t submitted = 0;
+    std::uint64_t completed = 0;
+    unsigned int workers = 0;
+    queue_stats queue;
+    /// Time from the submission to the start of the tasks (ns)
+    histogram wait_ns;
+    /// Running time of the tasks (ns)
+    histogram service_ns;
+    std::vector<worker_stats> per_worker;
+
+    void print(std::FILE *out = stdout) const {
+        std::fprintf(out,
+                     "submitted %llu, completed %llu, workers %u, queue depth %zu (high water "
+                     "%zu)\n",
+                     static_cast<unsigned long long>(submitted),
+                     static_cast<unsigned long long>(completed), workers, queue.depth(),
+                     queue.high_water);
+        histogram::print_header(out);
+        wait_ns.print("task wait", out);
+        service_ns.print("task service", out);
+        std::fprintf(out, "%-8s %12s %14s %14s %8s\n", "worker", "completed", "busy ms", "idle ms",
+                     "busy %");
+        for (const auto &w : per_worker) {
+            std::fprintf(out, "%-8u %12llu %14.1f %14.1f %7.1f%%%s\n", w.id,
+                         static_cast<unsigned long long>(w.completed),
+                         static_cast<double>(w.busy_ns) / 1e6,
+                         static_cast<double>(w.idle_ns) / 1e6, 100.0 * w.utilization(),
+                         w.retired ? " (retired)" : "");
+        }
+    }
+};
+
+class threadpool {
+    using uint = unsigned int;
+    using thread = std::thread;
+    using clock = std::chrono::steady_clock;
+
+    /// The task type is an aliasing of an optional void function.
+    /// The empty task (std::nullopt) signals the end of the stream.
+    using task = std::optional<std::function<void()>>;
+
+    /// A task with its submission time, to know how long it waited.
+    struct queued_task {
+        task fun;
+        clock::time_point submitted;
+    };
+
+    template <typename T>
+    using vector = std::vector<T>;
+    template <typename T>
+    using uqueue = spm::unbounded_queue<T>;
+
+    /// Metrics written by a single worker with relaxed atomics, read by metrics().
+    struct alignas(64) worker_counters {
+        std::atomic<std::uint64_t> completed{0};
+        std::atomic<std::uint64_t> busy_ns{0};
+        std::atomic<std::uint64_t> idle_ns{0};
+        std::atomic<bool> retired{false};
+        concurrent_histogram wait_ns;
+        concurrent_histogram service_ns;
+
+        void add(std::atomic<std::uint64_t> &counter, std::uint64_t value) noexcept {
+            counter.store(counter.load(std::memory_order_relaxed) + value,
+                          std::memory_order_relaxed);
+        }
+    };
+
+   private:
+    elastic_options bounds;
+
+    uqueue<queued_task> tasks;
+    std::atomic<std::uint64_t> submitted{0};
+
+    /// Workers by id: the retired ones are joined by the next spawn or by
+    /// the shutdown, since a thread cannot join itself.
+    std::mutex workers_lock;
+    std::map<uint, thread> workers;
+    vector<uint> retired;
+    uint next_id = 0;
+    uint live = 0;
+    bool stopping = false;
+    /// Counters by worker id, kept after the retirement of the workers
+    vector<std::unique_ptr<worker_counters>> counters;
+
+    // Periodic dump of the metrics
+    std::thread dumper;
+    std::mutex dumper_lock;
+    std::condition_variable dumper_cv;
+    bool dumper_stop = false;
+
+    static std::uint64_t ns_between(clock::time_point from, clock::time_point to) noexcept {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+    }
+
+    /// Start a worker if the bounds allow it.
+    void spawn() {
+        std::lock_guard<std::mutex> lock(workers_lock);
+        if (stopping || live >= bounds.max_workers) return;
+
+        for (auto id : retired) {
+            workers[id].join();
+            workers.erase(id);
+        }
+        retired.clear();
+
+        auto id = next_id++;
+        live++;
+        counters.push_back(std::make_unique<worker_counters>());
+        auto *stats = counters.back().get();
+        workers.emplace(id, thread([this, id, stats]() -> void { this->loop(id, *stats); }));
+    }
+
+    /// Whether the idle worker can leave, in which case it is marked retired.
+    bool retire(uint id) {
+        std::lock_guard<std::mutex> lock(workers_lock);
+        // While stopping every worker waits for its poison pill
+        if (stopping || live <= bounds.min_workers) return false;
+        live--;
+        retired.push_back(id);
+        counters[id]->retired.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    void enqueue(task fun) {
+        submitted.fetch_add(1, std::memory_order_relaxed);
+        tasks.enqueue(queued_task{std::move(fun), clock::now()});
+        if (elastic() && tasks.size() > bounds.max_queue_depth) spawn();
+    }
+
+    void loop(uint id, worker_counters &stats) {
+        while (true) {
+            auto idle_from = clock::now();
+
+            // Fetch task from queue (a fixed pool never times out)
+            std::optional<queued_task> next_task;
+            if (elastic()) {
+                next_task = tasks.dequeue_for(bounds.idle_timeout);
+                if (!next_task) {
+                    stats.add(stats.idle_ns, ns_between(idle_from, clock::now()));
+                    if (retire(id)) break;
+                    continue;
+                }
+            } else {
+                next_task = tasks.dequeue();
+            }
+
+            auto start = clock::now();
+            stats.add(stats.idle_ns, ns_between(idle_from, start));
+
+            if (!next_task->fun) {
+                // An empty task is the ending of stream message.
+                // Break the loop for the poison pill
+                break;
+            }
+
+            auto waited = start - next_task->submitted;
+            stats.wait_ns.record(ns_between(next_task->submitted, start));
+
+            // The queue does not drain fast enough: add a worker
+            if (elastic() && waited > bounds.max_queue_wait && tasks.size() > 0) spawn();
+
+            (*next_task->fun)();  // Perform the task
+
+            auto service = ns_between(start, clock::now());
+            stats.service_ns.record(service);
+            stats.add(stats.busy_ns, service);
+            stats.add(stats.completed, 1);
+        }
+    }
+
+    bool elastic() const noexcept { return bounds.min_workers < bounds.max_workers; }
+
+   public:
+    threadpool() : threadpool(thread::hardware_concurrency()) {}
+
+    explicit threadpool(uint _nw) {
+        bounds.min_workers = bounds.max_workers = std::max(_nw, 1u);
+        for (uint i = 0; i < bounds.min_workers; i++) spawn();
+    }
+
+    /// Elastic pool, sized between the given bounds by the queue.
+    explicit threadpool(const elastic_options &options) : bounds(options) {
+        bounds.min_workers = std::max(bounds.min_workers, 1u);
+        bounds.max_workers = std::max(bounds.max_workers, bounds.min_workers);
+        for (uint i = 0; i < bounds.min_workers; i++) spawn();
+    }
+
+    /// Current number of workers (already stale in an elastic pool).
+    uint size() noexcept {
+        std::lock_guard<std::mutex> lock(workers_lock);
+        return live;
+    }
+
+    /// Snapshot of the counters, taken without stopping the workers.
+    threadpool_metrics metrics() {
+        threadpool_metrics m;
+        m.submitted = submitted.load(std::memory_order_relaxed);
+        m.queue = tasks.stats();
+
+        std::lock_guard<std::mutex> lock(workers_lock);
+        m.workers = live;
+        for (uint id = 0; id < counters.size(); id++) {
+            const auto &c = *counters[id];
+            worker_stats w;
+            w.id = id;
+            w.retired = c.retired.load(std::memory_order_relaxed);
+            w.completed = c.completed.load(std::memory_order_relaxed);
+            w.busy_ns = c.busy_ns.load(std::memory_order_relaxed);
+            w.idle_ns = c.idle_ns.load(std::memory_order_relaxed);
+            m.completed += w.completed;
+            m.per_worker.push_back(w);
+            m.wait_ns.merge(c.wait_ns.snapshot());
+            m.service_ns.merge(c.service_ns.snapshot());
+        }
+        return m;
+    }
+
+    /***
+     * Append a timestamped metrics() report to the file at path every
+     * interval, from a background thread, until the shutdown (which writes
+     * a last one). Returns false if the file cannot be opened or a dump is
+     * already running.
+     */
+    bool dump_metrics(const std::string &path, std::chrono::milliseconds interval) {
+        if (dumper.joinable()) return false;
+        auto *file = std::fopen(path.c_str(), "a");
+        if (file == nullptr) return false;
+
+        dumper = thread([this, file, interval]() {
+            auto dump = [&]() {
+                auto now = std::time(nullptr);
+                std::tm local{};
+                char stamp[32];
+                std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &local));
+                std::fprintf(file, "# %s\n", stamp);
+                metrics().print(file);
+                std::fflush(file);
+            };
+
+            std::unique_lock<std::mutex> lock(dumper_lock);
+            while (!dumper_cv.wait_for(lock, interval, [&]() { return dumper_stop; })) dump();
+            dump();
+            std::fclose(file);
+        });
+        return true;
+    }
+
+    template <typename Out, typename... In>
+    auto submit(Out &&fun, In &&...args) {
+        // https://floating.io/2017/07/lambda-shared_ptr-memory-leak/
+        using ReturnType = decltype(fun(args...));
+
+        auto future = std::make_shared<spm::future<ReturnType>>();
+        std::weak_ptr<spm::future<ReturnType>> weak_ref(future);
+
+        auto task_wrapper = [weak_ref, fun, args...]() {
+            if (auto f = weak_ref.lock()) {
+                f->put(fun(args...));
+            }
+        };
+
+        enqueue(task{task_wrapper});
+
+        return future;
+    }
+
+    template <typename Out, typename... In>
+    void execute(Out &&fun, In &&...args) noexcept {
+        auto bind = std::bind(fun, std::forward<In>(args)...);
+        enqueue(task{bind});
+    }
+
+    void shutdown() noexcept {
+        // Request the shutdown: no worker is added or retired from now on
+        std::map<uint, thread> to_join;
+        uint pills;
+        {
+            std::lock_guard<std::mutex> lock(workers_lock);
+            stopping = true;
+            pills = live;
+            to_join.swap(workers);
+        }
+        // Inject a poison pill in the queue for each live worker
+        for (uint i = 0; i < pills; i++) tasks.enqueue(queued_task{std::nullopt, clock::now()});
+        // Wait for all threads terminating their execution...
+        for (auto &[id, t] : to_join) t.join();
+
+        if (dumper.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(dumper_lock);
+                dumper_stop = true;
+            }
+            dumper_cv.notify_one();
+            dumper.join();
+        }
+    }
+};
+}  // namespace spm
+
+#endif
\ No newline at end of file
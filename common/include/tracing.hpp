@@ -0,0 +1,194 @@
+#ifndef SPM_TRACING_H
+#define SPM_TRACING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tsc.hpp"
+
+namespace spm {
+
+/***
+ * Task event tracer. Each thread owns a preallocated ring buffer and it is
+ * the only writer of it, so recording an event is a couple of stores: no
+ * locks, no atomics, no allocations. When a buffer is full the oldest
+ * records get overwritten. Buffers must be read (i.e. exported) only once
+ * the traced threads are done.
+ */
+class tracer {
+   public:
+    enum class event : std::uint8_t { emit, start, end };
+
+    struct record {
+        std::uint64_t task;
+        std::uint64_t tsc;
+        std::uint32_t thread;
+        event what;
+    };
+
+   private:
+    struct alignas(64) ring_buffer {
+        std::vector<record> records;
+        std::size_t head = 0;
+    };
+
+    std::vector<ring_buffer> buffers;
+    std::size_t mask;
+
+    tsc_clock clock;
+
+    static std::size_t round_to_pow2(std::size_t n) {
+        std::size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    double to_us(std::uint64_t t) const { return clock.to_ns(t - clock.start()) / 1000.0; }
+
+    /// Per task view of the traced events, timestamps in microseconds.
+    struct task_span {
+        std::uint32_t emitter = 0;
+        std::uint32_t thread = 0;
+        double emit = -1.0;
+        double start = -1.0;
+        double end = -1.0;
+    };
+
+    std::map<std::uint64_t, task_span> spans() const {
+        std::map<std::uint64_t, task_span> result;
+        for (const auto &r : records()) {
+            auto &s = result[r.task];
+            switch (r.what) {
+                case event::emit:
+                    s.emit = to_us(r.tsc);
+                    s.emitter = r.thread;
+                    break;
+                case event::start:
+                    s.start = to_us(r.tsc);
+                    s.thread = r.thread;
+                    break;
+                case event::end:
+                    s.end = to_us(r.tsc);
+                    break;
+            }
+        }
+        return result;
+    }
+
+   public:
+    tracer(std::size_t threads, std::size_t capacity = 1 << 16)
+        : buffers(threads), mask(round_to_pow2(capacity) - 1) {
+        for (auto &b : buffers) b.records.resize(mask + 1);
+    }
+
+    /// Hot path: must be called only by the owner of the thread slot.
+    void trace(std::size_t thread, std::uint64_t task, event what) noexcept {
+        auto &b = buffers[thread];
+        b.records[b.head & mask] =
+            record{task, tsc(), static_cast<std::uint32_t>(thread), what};
+        b.head++;
+    }
+
+    /// All the records still in the buffers, sorted by timestamp.
+    std::vector<record> records() const {
+        std::vector<record> all;
+        for (const auto &b : buffers) {
+            auto count = std::min(b.head, mask + 1);
+            for (auto i = b.head - count; i < b.head; i++)
+                all.push_back(b.records[i & mask]);
+        }
+        std::sort(all.begin(), all.end(),
+                  [](const record &a, const record &b) { return a.tsc < b.tsc; });
+        return all;
+    }
+
+    /// Export the trace using the Chrome trace-event format (chrome://tracing).
+    bool write_chrome_trace(const std::string &path) const {
+        auto *file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+
+        std::fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        for (const auto &[task, s] : spans()) {
+            auto id = static_cast<unsigned long long>(task);
+            if (s.emit >= 0.0) {
+                std::fprintf(file,
+                             "%s{\"name\":\"emit %llu\",\"ph\":\"i\",\"s\":\"g\","
+                             "\"ts\":%.3f,\"pid\":0,\"tid\":%u}",
+                             first ? "" : ",\n", id, s.emit, s.emitter);
+                first = false;
+            }
+            if (s.start >= 0.0 && s.end >= 0.0) {
+                std::fprintf(file,
+                             "%s{\"name\":\"task %llu\",\"ph\":\"X\",\"ts\":%.3f,"
+                             "\"dur\":%.3f,\"pid\":0,\"tid\":%u,"
+                             "\"args\":{\"queueing_us\":%.3f}}",
+                             first ? "" : ",\n", id, s.start, s.end - s.start,
+                             s.thread, s.emit >= 0.0 ? s.start - s.emit : 0.0);
+                first = false;
+            }
+        }
+        std::fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+        return std::fclose(file) == 0;
+    }
+
+    /// Export one row per task: timestamps, queueing delay and service time.
+    bool write_csv(const std::string &path) const {
+        auto *file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+
+        std::fprintf(file, "task,thread,emit_us,start_us,end_us,queueing_us,service_us\n");
+        for (const auto &[task, s] : spans()) {
+            std::fprintf(file, "%llu,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                         static_cast<unsigned long long>(task), s.thread,
+                         s.emit, s.start, s.end,
+                         (s.emit >= 0.0 && s.start >= 0.0) ? s.start - s.emit : 0.0,
+                         (s.start >= 0.0 && s.end >= 0.0) ? s.end - s.start : 0.0);
+        }
+
+        return std::fclose(file) == 0;
+    }
+
+    /// Print busy time and utilization of each thread, and the mean queueing delay.
+    void print_summary(std::FILE *out = stdout) const {
+        auto all = spans();
+
+        double first = -1.0, last = 0.0, queueing = 0.0;
+        std::size_t queued = 0;
+        std::vector<double> busy(buffers.size(), 0.0);
+        std::vector<std::size_t> tasks(buffers.size(), 0);
+
+        for (const auto &[_, s] : all) {
+            if (s.start < 0.0 || s.end < 0.0) continue;
+            busy[s.thread] += s.end - s.start;
+            tasks[s.thread]++;
+            if (s.emit >= 0.0) {
+                queueing += s.start - s.emit;
+                queued++;
+            }
+            auto begin = (s.emit >= 0.0) ? s.emit : s.start;
+            first = (first < 0.0) ? begin : std::min(first, begin);
+            last = std::max(last, s.end);
+        }
+
+        auto span = std::max(last - first, 1e-9);
+        std::fprintf(out, "Traced %zu tasks over %.3f ms\n", all.size(), span / 1000.0);
+        for (std::size_t t = 0; t < busy.size(); t++) {
+            std::fprintf(out, "Thread %zu: %zu tasks, busy %.3f ms, utilization %.1f%%\n",
+                         t, tasks[t], busy[t] / 1000.0, 100.0 * busy[t] / span);
+        }
+        if (queued > 0) {
+            std::fprintf(out, "Mean queueing delay: %.3f ms\n",
+                         queueing / static_cast<double>(queued) / 1000.0);
+        }
+    }
+};
+
+}  // namespace spm
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SPM_TSC_H
+#define SPM_TSC_H
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+namespace spm {
+
+/// Read the time stamp counter (or a steady clock on non x86 targets).
+inline std::uint64_t tsc() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/***
+ * Converts TSC ticks to nanoseconds, by comparing the ticks elapsed since
+ * the construction with the steady clock. The longer the interval before
+ * the first conversion, the more accurate the ratio.
+ */
+class tsc_clock {
+    std::uint64_t tsc_start;
+    std::chrono::steady_clock::time_point clock_start;
+    mutable double ns_per_tick = 0.0;
+
+   public:
+    tsc_clock() : tsc_start(tsc()), clock_start(std::chrono::steady_clock::now()) {}
+
+    std::uint64_t start() const noexcept { return tsc_start; }
+
+    double to_ns(std::uint64_t ticks) const {
+        if (ns_per_tick == 0.0) {
+            auto elapsed = tsc() - tsc_start;
+            auto ns = std::chrono::duration<double, std::nano>(
+                          std::chrono::steady_clock::now() - clock_start)
+                          .count();
+            ns_per_tick = (elapsed > 0) ? ns / static_cast<double>(elapsed) : 1.0;
+        }
+        return static_cast<double>(ticks) * ns_per_tick;
+    }
+};
+
+}  // namespace spm
+
+#endif
@@ -1,9 +1,27 @@
 #ifndef SPM_UNBOUNDED_QUEUE_H
 #define SPM_UNBOUNDED_QUEUE_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
 #include <queue>
 
 namespace spm {
+
+/// Counters of a queue since its creation.
+struct queue_stats {
+    std::uint64_t enqueued = 0;
+    std::uint64_t dequeued = 0;
+    /// Largest number of elements queued at the same time
+    std::size_t high_water = 0;
+
+    std::size_t depth() const noexcept { return static_cast<std::size_t>(enqueued - dequeued); }
+};
+
 template <typename T>
 class unbounded_queue {
    private:
@@ -11,14 +29,36 @@ class unbounded_queue {
     std::mutex queue_lock;
     std::condition_variable cv;
 
+    // Written under the lock, read without it by stats()
+    std::atomic<std::uint64_t> enqueued{0};
+    std::atomic<std::uint64_t> dequeued{0};
+    std::atomic<std::size_t> high_water{0};
+
+    void count_enqueue() noexcept {
+        enqueued.store(enqueued.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (queue.size() > high_water.load(std::memory_order_relaxed)) {
+            high_water.store(queue.size(), std::memory_order_relaxed);
+        }
+    }
+
+    void count_dequeue() noexcept {
+        dequeued.store(dequeued.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
    public:
-    void enqueue(const T &&e) noexcept {
-        std::lock_guard<std::mutex> lock(queue_lock);
-        // Insert the element in the queue
-        queue.push(std::move(e));
-        cv.notify_all();
+    void enqueue(T &&e) noexcept {
+        {
+            std::lock_guard<std::mutex> lock(queue_lock);
+            // Insert the element in the queue
+            queue.push(std::move(e));
+            count_enqueue();
+        }
+        // A single element can wake up a single consumer
+        cv.notify_one();
     }
 
+    void enqueue(const T &e) noexcept { enqueue(T{e}); }
+
     T dequeue() noexcept {
         std::unique_lock<std::mutex> lock(queue_lock);
 
@@ -26,13 +66,45 @@ class unbounded_queue {
         cv.wait(lock, [&]() { return !queue.empty(); });
 
         // Someone inserted an element, we can pop it from the queue
-        auto front = queue.front();
+        auto front = std::move(queue.front());
         // Remove the element from the queue
         queue.pop();
+        count_dequeue();
+
+        return front;
+    }
+
+    /// Dequeue waiting at most timeout, std::nullopt if the queue stayed empty.
+    template <typename Rep, typename Period>
+    std::optional<T> dequeue_for(const std::chrono::duration<Rep, Period> &timeout) noexcept {
+        std::unique_lock<std::mutex> lock(queue_lock);
+
+        if (!cv.wait_for(lock, timeout, [&]() { return !queue.empty(); })) {
+            return std::nullopt;
+        }
+
+        auto front = std::move(queue.front());
+        queue.pop();
+        count_dequeue();
 
         return front;
     }
+
+    queue_stats stats() const noexcept {
+        queue_stats s;
+        // Dequeued first: it can only fall behind enqueued
+        s.dequeued = dequeued.load(std::memory_order_relaxed);
+        s.enqueued = std::max(enqueued.load(std::memory_order_relaxed), s.dequeued);
+        s.high_water = high_water.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    /// Number of queued elements (already stale when it is returned).
+    std::size_t size() noexcept {
+        std::lock_guard<std::mutex> lock(queue_lock);
+        return queue.size();
+    }
 };
 }  // namespace spm
 
-#endif
\ No newline at end of file
+#endif
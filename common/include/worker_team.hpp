@@ -0,0 +1,145 @@
+#ifndef SPM_WORKER_TEAM_H
+#define SPM_WORKER_TEAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "partitioner.hpp"
+
+namespace spm {
+
+/// Hint the CPU that the thread is spinning (saves power and the pipeline flush).
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/***
+ * Sense-reversing barrier: the last thread arriving resets the counter and
+ * flips the sense (here a generation number), releasing the others. Waiters
+ * spin for a short while, since the release is usually close in parallel
+ * loops, then sleep on a futex (std::atomic::wait) not to steal the cores.
+ * With more parties than hardware threads spinning only delays the threads
+ * to be waited for, so waiters sleep right away.
+ * The releaser wakes the futex only when someone is sleeping, so a barrier
+ * among spinning threads needs no system calls.
+ */
+class spin_barrier {
+    static constexpr int SPINS = 2048;
+
+    const std::uint32_t parties;
+    const int spins;
+    alignas(64) std::atomic<std::uint32_t> waiting;
+    alignas(64) std::atomic<std::uint32_t> generation{0};
+    alignas(64) std::atomic<std::uint32_t> sleepers{0};
+
+   public:
+    explicit spin_barrier(std::uint32_t parties)
+        : parties(parties),
+          spins(parties <= std::max(1u, std::thread::hardware_concurrency()) ? SPINS : 0),
+          waiting(parties) {}
+
+    spin_barrier(const spin_barrier &) = delete;
+    spin_barrier &operator=(const spin_barrier &) = delete;
+
+    void arrive_and_wait() noexcept {
+        auto gen = generation.load(std::memory_order_acquire);
+
+        if (waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            waiting.store(parties, std::memory_order_relaxed);
+            generation.fetch_add(1, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) > 0) generation.notify_all();
+            return;
+        }
+
+        for (int i = 0; i < spins; i++) {
+            if (generation.load(std::memory_order_acquire) != gen) return;
+            cpu_relax();
+        }
+
+        // Either the releaser sees the sleeper, or the wait sees the new generation
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        while (generation.load(std::memory_order_seq_cst) == gen) generation.wait(gen);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+/***
+ * Team of threads kept alive between parallel regions. The calling thread
+ * is member 0 and nw - 1 workers are parked on a spin_barrier, so running
+ * a region costs two barriers instead of creating and joining nw threads:
+ * repeated data parallel calls (map, sort rounds, reductions) can reuse it.
+ * Regions cannot be nested, nor run by more than one thread at a time.
+ */
+class worker_team {
+    using body_fun = void (*)(void *, std::size_t);
+
+    std::size_t nw;
+    spin_barrier barrier;
+    std::vector<std::thread> threads;
+
+    // Region to run, published to the workers by the start barrier
+    body_fun region = nullptr;
+    void *context = nullptr;
+    bool stop = false;
+
+    void loop(std::size_t id) {
+        while (true) {
+            barrier.arrive_and_wait();  // Start of a region
+            if (stop) return;
+            region(context, id);
+            barrier.arrive_and_wait();  // End of the region
+        }
+    }
+
+   public:
+    explicit worker_team(std::size_t nw = std::thread::hardware_concurrency())
+        : nw(std::max<std::size_t>(nw, 1)), barrier(static_cast<std::uint32_t>(this->nw)) {
+        for (std::size_t i = 1; i < this->nw; i++) threads.emplace_back([this, i]() { loop(i); });
+    }
+
+    ~worker_team() {
+        stop = true;
+        barrier.arrive_and_wait();
+        for (auto &t : threads) t.join();
+    }
+
+    worker_team(const worker_team &) = delete;
+    worker_team &operator=(const worker_team &) = delete;
+
+    std::size_t size() const noexcept { return nw; }
+
+    /// Run f(id) on every member of the team, id in [0, size()), and wait for all of them.
+    template <typename Fun>
+    void run(Fun &&f) {
+        using fun_type = std::remove_reference_t<Fun>;
+        region = [](void *ctx, std::size_t id) { (*static_cast<fun_type *>(ctx))(id); };
+        context = const_cast<void *>(static_cast<const void *>(&f));
+
+        barrier.arrive_and_wait();
+        f(std::size_t{0});
+        barrier.arrive_and_wait();
+    }
+
+    /// Synchronize the members inside a region (all of them must call it).
+    void sync() noexcept { barrier.arrive_and_wait(); }
+
+    /// Run body(range) on a static block of [first, last) per member.
+    template <typename Body>
+    void parallel_for(std::size_t first, std::size_t last, Body &&body) {
+        auto blocks = block_partition(first, last, nw);
+        run([&](std::size_t id) { body(blocks[id]); });
+    }
+};
+
+}  // namespace spm
+
+#endif
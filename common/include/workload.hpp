@@ -0,0 +1,231 @@
+#ifndef SPM_WORKLOAD_H
+#define SPM_WORKLOAD_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "random.hpp"
+
+namespace spm::workload {
+
+/// Keep the compiler from optimizing away the computation of value.
+template <typename T>
+inline void consume(const T &value) noexcept {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+namespace detail {
+
+/// Minimum time of some runs of f, in nanoseconds.
+template <typename Fun>
+double min_time_ns(Fun &&f, int runs = 5) {
+    double best = 0;
+    for (int r = 0; r < runs; r++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+                      .count();
+        if (r == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+}  // namespace detail
+
+/***
+ * Compute bound kernel: 8 independent chains of multiply-adds, 16 FLOPs per
+ * iteration, on registers only. The chains keep the FP pipelines busy like
+ * a real numeric kernel, while the dependencies stop the compiler from
+ * collapsing the loop.
+ */
+inline double compute(std::uint64_t iterations) noexcept {
+    double x[8] = {1.0, 1.1, 1.2, 1.3, 1.4, 1.5, 1.6, 1.7};
+    for (std::uint64_t i = 0; i < iterations; i++) {
+        for (auto &v : x) v = v * 0.999999 + 1e-7;
+    }
+    consume(x);
+    return x[0] + x[7];
+}
+
+/// Nanoseconds of an iteration of compute() on this machine, measured once.
+inline double compute_ns_per_iteration() {
+    static const double ns = []() {
+        constexpr std::uint64_t ITERATIONS = 1 << 18;
+        return detail::min_time_ns([]() { compute(ITERATIONS); }) / ITERATIONS;
+    }();
+    return ns;
+}
+
+/// Run compute() for about the given time (no clock reads while working).
+inline void compute_for(std::chrono::nanoseconds time) {
+    auto ns = static_cast<double>(time.count());
+    compute(static_cast<std::uint64_t>(ns / compute_ns_per_iteration()));
+}
+
+/***
+ * Memory bound kernels over a working set of the given bytes, one node per
+ * cache line. stream() reads it sequentially (bandwidth bound, prefetcher
+ * friendly), chase() follows a random cyclic permutation of the nodes
+ * (latency bound, one miss per step once the set exceeds the caches).
+ * Each kernel is calibrated on the working set at its first timed use.
+ */
+class working_set {
+    struct alignas(64) node {
+        node *next;
+        std::uint64_t payload[7];
+    };
+
+    std::vector<node> nodes;
+    node *cursor;
+    std::optional<double> stream_ns_per_node;
+    std::optional<double> chase_ns_per_step;
+
+   public:
+    explicit working_set(std::size_t bytes, std::uint64_t seed = 2122)
+        : nodes(std::max<std::size_t>(bytes / sizeof(node), 2)) {
+        // Sattolo's shuffle: a single cycle through all the nodes
+        std::vector<std::size_t> order(nodes.size());
+        std::iota(order.begin(), order.end(), 0);
+        for (std::size_t i = order.size() - 1; i > 0; i--) {
+            auto j = random_at(seed, i) % i;
+            std::swap(order[i], order[j]);
+        }
+        for (std::size_t i = 0; i < nodes.size(); i++) {
+            nodes[i].next = &nodes[order[i]];
+            std::fill(std::begin(nodes[i].payload), std::end(nodes[i].payload), i);
+        }
+        cursor = nodes.data();
+    }
+
+    working_set(const working_set &) = delete;
+    working_set &operator=(const working_set &) = delete;
+
+    std::size_t bytes() const noexcept { return nodes.size() * sizeof(node); }
+
+    /// Read passes times the whole working set.
+    std::uint64_t stream(std::size_t passes = 1) noexcept {
+        std::uint64_t sum = 0;
+        for (std::size_t p = 0; p < passes; p++) {
+            for (const auto &n : nodes) {
+                for (auto v : n.payload) sum += v;
+            }
+        }
+        consume(sum);
+        return sum;
+    }
+
+    /// Follow steps pointers, continuing from where the last chase stopped.
+    void chase(std::uint64_t steps) noexcept {
+        auto *n = cursor;
+        for (std::uint64_t i = 0; i < steps; i++) n = n->next;
+        cursor = n;
+        consume(cursor);
+    }
+
+    /// Stream over the working set (or part of it) for about the given time.
+    void stream_for(std::chrono::nanoseconds time) {
+        if (!stream_ns_per_node) {
+            stream_ns_per_node = detail::min_time_ns([&]() { stream(); }, 3) /
+                                 static_cast<double>(nodes.size());
+        }
+
+        auto todo = static_cast<std::uint64_t>(static_cast<double>(time.count()) /
+                                                *stream_ns_per_node);
+        stream(todo / nodes.size());
+
+        std::uint64_t sum = 0;
+        for (std::size_t i = 0; i < todo % nodes.size(); i++) {
+            for (auto v : nodes[i].payload) sum += v;
+        }
+        consume(sum);
+    }
+
+    /// Chase pointers for about the given time.
+    void chase_for(std::chrono::nanoseconds time) {
+        if (!chase_ns_per_step) {
+            // A full cycle, so the calibration sees the misses of the whole set
+            auto steps = static_cast<std::uint64_t>(nodes.size());
+            chase_ns_per_step = detail::min_time_ns([&]() { chase(steps); }, 3) /
+                                static_cast<double>(steps);
+        }
+        chase(static_cast<std::uint64_t>(static_cast<double>(time.count()) / *chase_ns_per_step));
+    }
+};
+
+/// Kind of work of a synthetic task.
+///  - compute: multiply-adds on registers
+///  - stream:  sequential reads of a working set
+///  - chase:   dependent random reads of a working set
+///  - mixed:   half of the time compute, half chase
+enum class kind { compute, stream, chase, mixed };
+
+inline std::optional<kind> parse_kind(std::string_view name) noexcept {
+    if (name == "compute") return kind::compute;
+    if (name == "stream") return kind::stream;
+    if (name == "chase") return kind::chase;
+    if (name == "mixed") return kind::mixed;
+    return std::nullopt;
+}
+
+/***
+ * Synthetic task of a given service time, e.g. for the workers of a farm.
+ * Memory bound kinds use a working set private to each calling thread, so
+ * the cache behaviour is the one of a worker owning its data.
+ */
+class task_model {
+    kind work;
+    std::size_t working_set_bytes;
+
+    working_set &local_set() const {
+        thread_local std::unique_ptr<working_set> set;
+        if (!set || set->bytes() < working_set_bytes) {
+            set = std::make_unique<working_set>(working_set_bytes);
+        }
+        return *set;
+    }
+
+   public:
+    explicit task_model(kind work = kind::compute, std::size_t working_set_bytes = 1 << 20)
+        : work(work), working_set_bytes(working_set_bytes) {}
+
+    /// Build the calibration and the working set of the calling thread, so
+    /// they are not paid by its first task.
+    void prepare() const {
+        if (work == kind::compute || work == kind::mixed) compute_ns_per_iteration();
+        if (work != kind::compute) {
+            // Calibrate on a short run
+            auto &set = local_set();
+            if (work == kind::stream) set.stream_for(std::chrono::nanoseconds(1));
+            else set.chase_for(std::chrono::nanoseconds(1));
+        }
+    }
+
+    void operator()(std::chrono::nanoseconds service_time) const {
+        switch (work) {
+            case kind::compute:
+                compute_for(service_time);
+                break;
+            case kind::stream:
+                local_set().stream_for(service_time);
+                break;
+            case kind::chase:
+                local_set().chase_for(service_time);
+                break;
+            case kind::mixed:
+                compute_for(service_time / 2);
+                local_set().chase_for(service_time - service_time / 2);
+                break;
+        }
+    }
+};
+
+}  // namespace spm::workload
+
+#endif